@@ -0,0 +1,590 @@
+#include "bit-array-index.h"
+#include "bit-array.h"
+#include "elias-fano.h"
+#include "packed-int-array.h"
+#include "slot-allocator.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Sizes from one word to 2^30 bits, every step is 8 times larger
+static void SizeArgs(benchmark::internal::Benchmark *b) {
+  b->RangeMultiplier(8)->Range(64, 1L << 30);
+}
+
+// Random positions in [0, size), so generation is out of the loop
+static std::vector<size_t> RandomPositions(size_t size) {
+  std::mt19937_64 gen(size);
+  std::vector<size_t> positions(4096);
+
+  for (size_t &pos : positions) {
+    pos = gen() % size;
+  }
+
+  return positions;
+}
+
+// Bits are processed once per iteration
+static void SetBitsProcessed(benchmark::State &state, int passes = 1) {
+  state.SetBytesProcessed(passes * state.iterations() * state.range(0) /
+                          CHAR_BIT);
+}
+
+static void BM_Get(benchmark::State &state) {
+  const BitArray ba(state.range(0), 0x5555555555555555UL);
+  const std::vector<size_t> positions = RandomPositions(state.range(0));
+  size_t i = 0;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ba[positions[i++ % positions.size()]]);
+  }
+}
+BENCHMARK(BM_Get)->Apply(SizeArgs);
+
+static void BM_Set(benchmark::State &state) {
+  BitArray ba(state.range(0));
+  const std::vector<size_t> positions = RandomPositions(state.range(0));
+  size_t i = 0;
+
+  for (auto _ : state) {
+    ba.set(positions[i++ % positions.size()]);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_Set)->Apply(SizeArgs);
+
+static void BM_Iterate(benchmark::State &state) {
+  const BitArray ba(state.range(0), 0x5555555555555555UL);
+
+  for (auto _ : state) {
+    size_t ones = 0;
+    for (bool bit : ba) {
+      ones += bit;
+    }
+    benchmark::DoNotOptimize(ones);
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_Iterate)->Apply(SizeArgs);
+
+static void BM_ForEachSetBit(benchmark::State &state) {
+  const BitArray ba(state.range(0), 0x0101010101010101UL);
+
+  for (auto _ : state) {
+    size_t sum = 0;
+    ba.for_each_set_bit([&](size_t i) { sum += i; });
+    benchmark::DoNotOptimize(sum);
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_ForEachSetBit)->Apply(SizeArgs);
+
+static void BM_FindNext(benchmark::State &state) {
+  const BitArray ba(state.range(0), 0x0101010101010101UL);
+
+  for (auto _ : state) {
+    size_t n = 0;
+    for (size_t i = ba.find_first(); i != BitArray::npos;
+         i = ba.find_next(i)) {
+      n++;
+    }
+    benchmark::DoNotOptimize(n);
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_FindNext)->Apply(SizeArgs);
+
+static void BM_Shift(benchmark::State &state) {
+  BitArray ba(state.range(0), ULONG_MAX);
+
+  for (auto _ : state) {
+    ba <<= 3;
+    ba >>= 3;
+    benchmark::ClobberMemory();
+  }
+
+  SetBitsProcessed(state, 2);
+}
+BENCHMARK(BM_Shift)->Apply(SizeArgs);
+
+static void BM_And(benchmark::State &state) {
+  BitArray a(state.range(0), ULONG_MAX);
+  const BitArray b(state.range(0), 0x5555555555555555UL);
+
+  for (auto _ : state) {
+    a &= b;
+    benchmark::ClobberMemory();
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_And)->Apply(SizeArgs);
+
+static void BM_Or(benchmark::State &state) {
+  BitArray a(state.range(0));
+  const BitArray b(state.range(0), 0x5555555555555555UL);
+
+  for (auto _ : state) {
+    a |= b;
+    benchmark::ClobberMemory();
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_Or)->Apply(SizeArgs);
+
+static void BM_Xor(benchmark::State &state) {
+  BitArray a(state.range(0));
+  const BitArray b(state.range(0), 0x5555555555555555UL);
+
+  for (auto _ : state) {
+    a ^= b;
+    benchmark::ClobberMemory();
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_Xor)->Apply(SizeArgs);
+
+// Expression of three arrays is evaluated in one pass
+static void BM_Expression(benchmark::State &state) {
+  const BitArray a(state.range(0), ULONG_MAX);
+  const BitArray b(state.range(0), 0x5555555555555555UL);
+  const BitArray c(state.range(0), 0x0f0f0f0f0f0f0f0fUL);
+  BitArray d(state.range(0));
+
+  for (auto _ : state) {
+    d = (a & ~b) | c;
+    benchmark::ClobberMemory();
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_Expression)->Apply(SizeArgs);
+
+static void BM_Count(benchmark::State &state) {
+  const BitArray ba(state.range(0), 0x5555555555555555UL);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ba.count());
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_Count)->Apply(SizeArgs);
+
+static void BM_ToString(benchmark::State &state) {
+  const BitArray ba(state.range(0), 0x5555555555555555UL);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ba.to_string());
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK(BM_ToString)->Apply(SizeArgs);
+
+template <BitArray::TextFormat Format>
+static void BM_ToChars(benchmark::State &state) {
+  const BitArray ba(state.range(0), 0x5555555555555555UL);
+  std::string text(BitArray::text_size(ba.size(), Format), '\0');
+
+  for (auto _ : state) {
+    ba.to_chars(&text[0], text.size(), Format);
+    benchmark::ClobberMemory();
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK_TEMPLATE(BM_ToChars, BitArray::TextFormat::binary)->Apply(SizeArgs);
+BENCHMARK_TEMPLATE(BM_ToChars, BitArray::TextFormat::hex)->Apply(SizeArgs);
+BENCHMARK_TEMPLATE(BM_ToChars, BitArray::TextFormat::base64)->Apply(SizeArgs);
+
+template <BitArray::TextFormat Format>
+static void BM_FromChars(benchmark::State &state) {
+  const std::string text =
+      BitArray(state.range(0), 0x5555555555555555UL).to_string(Format);
+  BitArray ba;
+
+  for (auto _ : state) {
+    ba.from_chars(text.data(), text.size(), Format);
+    benchmark::ClobberMemory();
+  }
+
+  SetBitsProcessed(state);
+}
+BENCHMARK_TEMPLATE(BM_FromChars, BitArray::TextFormat::binary)
+    ->Apply(SizeArgs);
+BENCHMARK_TEMPLATE(BM_FromChars, BitArray::TextFormat::hex)->Apply(SizeArgs);
+BENCHMARK_TEMPLATE(BM_FromChars, BitArray::TextFormat::base64)
+    ->Apply(SizeArgs);
+
+// Values of 'width' bits, the argument is the number of values
+static void PackedArgs(benchmark::internal::Benchmark *b) {
+  for (int width : {3, 12, 17, 32}) {
+    for (long size = 1024; size <= 1L << 24; size *= 64) {
+      b->Args({size, width});
+    }
+  }
+}
+
+static void BM_PackedGet(benchmark::State &state) {
+  PackedIntArray<> arr(state.range(0), state.range(1));
+  const size_t size = arr.size();
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i++) {
+      sum += arr[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetItemsProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_PackedGet)->Apply(PackedArgs);
+
+static void BM_PackedUnpack(benchmark::State &state) {
+  PackedIntArray<> arr(state.range(0), state.range(1));
+  std::vector<uint32_t> out(arr.size());
+
+  for (auto _ : state) {
+    arr.unpack(0, out.size(), out.data());
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_PackedUnpack)->Apply(PackedArgs);
+
+static void BM_PackedPack(benchmark::State &state) {
+  PackedIntArray<> arr(state.range(0), state.range(1));
+  std::vector<uint32_t> in(arr.size(), arr.mask());
+
+  for (auto _ : state) {
+    arr.pack(0, in.data(), in.size());
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_PackedPack)->Apply(PackedArgs);
+
+// Posting list of 'size' ids with mean gap of 8
+static std::vector<uint64_t> PostingList(size_t size) {
+  std::mt19937_64 gen(size);
+  std::vector<uint64_t> ids(size);
+  uint64_t id = 0;
+
+  for (uint64_t &value : ids) {
+    id += 1 + gen() % 15;
+    value = id;
+  }
+
+  return ids;
+}
+
+static void EliasFanoArgs(benchmark::internal::Benchmark *b) {
+  b->RangeMultiplier(64)->Range(1024, 1L << 24);
+}
+
+static void BM_EliasFanoAccess(benchmark::State &state) {
+  const EliasFano ef(PostingList(state.range(0)));
+  const std::vector<size_t> indices = RandomPositions(ef.size());
+
+  for (auto _ : state) {
+    for (size_t i : indices) {
+      benchmark::DoNotOptimize(ef.access(i));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * indices.size());
+}
+BENCHMARK(BM_EliasFanoAccess)->Apply(EliasFanoArgs);
+
+static void BM_EliasFanoNextGeq(benchmark::State &state) {
+  const EliasFano ef(PostingList(state.range(0)));
+  const std::vector<size_t> targets = RandomPositions(ef.back());
+
+  for (auto _ : state) {
+    for (size_t x : targets) {
+      benchmark::DoNotOptimize(*ef.next_geq(x));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * targets.size());
+}
+BENCHMARK(BM_EliasFanoNextGeq)->Apply(EliasFanoArgs);
+
+static void BM_EliasFanoDecode(benchmark::State &state) {
+  const EliasFano ef(PostingList(state.range(0)));
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (uint64_t value : ef) {
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetItemsProcessed(state.iterations() * ef.size());
+  state.counters["bits_per_value"] =
+      double(ef.size_in_bytes()) * CHAR_BIT / ef.size();
+}
+BENCHMARK(BM_EliasFanoDecode)->Apply(EliasFanoArgs);
+
+// Random 256-bit fingerprints
+static std::vector<BitArray> Fingerprints(size_t count, uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  std::vector<BitArray> vectors;
+
+  for (size_t v = 0; v < count; v++) {
+    BitArray vector(256);
+    for (size_t i = 0; i < 256; i += 64) {
+      const uint64_t word = gen();
+      vector.span(i, 64) ^= ConstBitSpan(&word, 0, 64);
+    }
+    vectors.push_back(vector);
+  }
+
+  return vectors;
+}
+
+static void IndexArgs(benchmark::internal::Benchmark *b) {
+  b->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+}
+
+// Baseline: separate arrays and count() of xor
+static void BM_NearestVectorOfBitArrays(benchmark::State &state) {
+  const std::vector<BitArray> vectors = Fingerprints(state.range(0), 1);
+  const BitArray query = Fingerprints(1, 2)[0];
+
+  for (auto _ : state) {
+    size_t best = 0, best_distance = size_t(-1);
+    for (size_t id = 0; id < vectors.size(); id++) {
+      const size_t distance = BitArray(vectors[id] ^ query).count();
+      if (distance < best_distance) {
+        best = id;
+        best_distance = distance;
+      }
+    }
+    benchmark::DoNotOptimize(best);
+  }
+
+  state.SetItemsProcessed(state.iterations() * vectors.size());
+}
+BENCHMARK(BM_NearestVectorOfBitArrays)->Apply(IndexArgs);
+
+static void BM_IndexSearch(benchmark::State &state) {
+  const BitArrayIndex index(Fingerprints(state.range(0), 1));
+  const BitArray query = Fingerprints(1, 2)[0];
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.search(query, 10));
+  }
+
+  state.SetItemsProcessed(state.iterations() * index.size());
+}
+BENCHMARK(BM_IndexSearch)->Apply(IndexArgs);
+
+// Queries are stored vectors with one flipped bit, the nearest one is
+// found by lookups, the next ones are random and need the scan
+static void BM_IndexSearchMultiIndex(benchmark::State &state) {
+  BitArrayIndex index(Fingerprints(state.range(0), 1));
+  index.build_multi_index();
+
+  std::vector<BitArray> queries;
+  for (size_t id : RandomPositions(index.size())) {
+    BitArray query = index.get(id);
+    query.set(id % 256, !query[id % 256]);
+    queries.push_back(query);
+    if (queries.size() == 64) {
+      break;
+    }
+  }
+
+  size_t q = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        index.search(queries[q++ % queries.size()], state.range(1)));
+  }
+
+  state.SetItemsProcessed(state.iterations() * index.size());
+}
+BENCHMARK(BM_IndexSearchMultiIndex)
+    ->ArgsProduct({benchmark::CreateRange(1 << 12, 1 << 20, 16), {1, 10}});
+
+static void BM_IndexSearchBatch(benchmark::State &state) {
+  const BitArrayIndex index(Fingerprints(state.range(0), 1));
+  const std::vector<BitArray> queries = Fingerprints(64, 2);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.search_batch(queries, 10));
+  }
+
+  state.SetItemsProcessed(state.iterations() * index.size() * queries.size());
+}
+BENCHMARK(BM_IndexSearchBatch)->Apply(IndexArgs)->UseRealTime();
+
+// Pools are filled slot by slot, so sizes stop at 2^24
+static void PoolArgs(benchmark::internal::Benchmark *b) {
+  b->RangeMultiplier(8)->Range(64, 1L << 24);
+}
+
+// Pool, which is full except one slot at a random place, claim and
+// release of this slot
+template <class Allocator>
+static void BM_SlotClaimRelease(benchmark::State &state) {
+  Allocator alloc(state.range(0));
+  while (alloc.claim() != Allocator::npos) {
+  }
+  alloc.release(RandomPositions(state.range(0))[0]);
+
+  for (auto _ : state) {
+    alloc.release(alloc.claim());
+  }
+}
+BENCHMARK_TEMPLATE(BM_SlotClaimRelease, SlotAllocator)->Apply(PoolArgs);
+BENCHMARK_TEMPLATE(BM_SlotClaimRelease, AtomicSlotAllocator)->Apply(PoolArgs);
+
+// Sizes above 2^32 bits, arrays take 512 MB and more
+static void HugeArgs(benchmark::internal::Benchmark *b) {
+  b->Arg((1L << 32) + 64)->Arg(1L << 33)->Unit(benchmark::kMillisecond);
+}
+
+static void BM_HugeCount(benchmark::State &state) {
+  BitArray ba(state.range(0), ULONG_MAX);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ba.count());
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(0) / CHAR_BIT);
+}
+BENCHMARK(BM_HugeCount)->Apply(HugeArgs);
+
+static void BM_HugeSetGet(benchmark::State &state) {
+  const size_t size = state.range(0);
+  BitArray ba(size);
+  size_t i = 0;
+
+  for (auto _ : state) {
+    // Stride is odd, so every word is eventually touched
+    i = (i + 0x9e3779b97f4a7c15UL) % size;
+    ba.set(i);
+    benchmark::DoNotOptimize(ba[size - 1 - i]);
+  }
+}
+BENCHMARK(BM_HugeSetGet)->Arg((1L << 32) + 64);
+
+static void BM_HugeShift(benchmark::State &state) {
+  BitArray ba(state.range(0), ULONG_MAX);
+
+  for (auto _ : state) {
+    ba >>= 3;
+    ba <<= 3;
+  }
+
+  state.SetBytesProcessed(2 * state.iterations() * state.range(0) / CHAR_BIT);
+}
+BENCHMARK(BM_HugeShift)->Apply(HugeArgs);
+
+static void BM_HugeAnd(benchmark::State &state) {
+  BitArray a(state.range(0), ULONG_MAX);
+  const BitArray b(state.range(0), 0x5555555555555555UL);
+
+  for (auto _ : state) {
+    a &= b;
+    benchmark::ClobberMemory();
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(0) / CHAR_BIT);
+}
+BENCHMARK(BM_HugeAnd)->Apply(HugeArgs);
+
+static void BM_HugeFindNext(benchmark::State &state) {
+  BitArray ba(state.range(0));
+  ba.set(state.range(0) - 1);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ba.find_next(0));
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(0) / CHAR_BIT);
+}
+BENCHMARK(BM_HugeFindNext)->Apply(HugeArgs);
+
+// Thread counts from 1 to all hardware threads on a 256 MB array
+static void ScalingArgs(benchmark::internal::Benchmark *b) {
+  const int max_threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    b->Args({1L << 31, threads});
+  }
+
+  // Workers are not counted in CPU time of the main thread
+  b->Args({1L << 31, max_threads});
+  b->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+// Run bulk operation with range(1) threads
+template <class F>
+static void RunScaling(benchmark::State &state, F f) {
+  BitKernels::set_threads(state.range(1));
+
+  for (auto _ : state) {
+    f();
+  }
+
+  BitKernels::set_threads(0);
+  state.SetBytesProcessed(state.iterations() * state.range(0) / CHAR_BIT);
+}
+
+static void BM_ScalingCount(benchmark::State &state) {
+  const BitArray ba(state.range(0), ULONG_MAX);
+  RunScaling(state, [&] { benchmark::DoNotOptimize(ba.count()); });
+}
+BENCHMARK(BM_ScalingCount)->Apply(ScalingArgs);
+
+static void BM_ScalingAny(benchmark::State &state) {
+  const BitArray ba(state.range(0));
+  RunScaling(state, [&] { benchmark::DoNotOptimize(ba.any()); });
+}
+BENCHMARK(BM_ScalingAny)->Apply(ScalingArgs);
+
+static void BM_ScalingAnd(benchmark::State &state) {
+  BitArray a(state.range(0), ULONG_MAX);
+  const BitArray b(state.range(0), ULONG_MAX);
+  RunScaling(state, [&] {
+    a &= b;
+    benchmark::ClobberMemory();
+  });
+}
+BENCHMARK(BM_ScalingAnd)->Apply(ScalingArgs);
+
+static void BM_ScalingSet(benchmark::State &state) {
+  BitArray ba(state.range(0));
+  RunScaling(state, [&] {
+    ba.set();
+    benchmark::ClobberMemory();
+  });
+}
+BENCHMARK(BM_ScalingSet)->Apply(ScalingArgs);
+
+static void BM_ScalingNot(benchmark::State &state) {
+  const BitArray a(state.range(0), ULONG_MAX);
+  BitArray b(state.range(0));
+  RunScaling(state, [&] {
+    b = ~a;
+    benchmark::ClobberMemory();
+  });
+}
+BENCHMARK(BM_ScalingNot)->Apply(ScalingArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,141 @@
+#include "atomic-bit-array.h"
+#include <stdexcept>
+
+// Private
+
+size_t AtomicBitArray::to_bytes(size_t bits) {
+  return bits / BitArray::byte_bits + (bits % BitArray::byte_bits ? 1 : 0);
+}
+
+byte_type AtomicBitArray::byte_mask(size_t i) const {
+  const int trail = bits % BitArray::byte_bits;
+  return i + 1 == byte_count() && trail > 0 ? (1UL << trail) - 1 : ~0UL;
+}
+
+void AtomicBitArray::check(size_t n, const char *msg) const {
+  if (n >= bits) {
+    throw std::out_of_range(msg);
+  }
+}
+
+// Public
+
+AtomicBitArray::AtomicBitArray() : bits(0) {}
+
+AtomicBitArray::AtomicBitArray(size_t num_bits)
+    : bytes(new std::atomic<byte_type>[to_bytes(num_bits)]), bits(num_bits) {
+  reset();
+}
+
+AtomicBitArray::AtomicBitArray(const BitArray &b) : AtomicBitArray(b.size()) {
+  for (size_t i = 0; i < byte_count(); i++) {
+    bytes[i].store(b.byte(i), std::memory_order_relaxed);
+  }
+}
+
+AtomicBitArray::AtomicBitArray(AtomicBitArray &&b) noexcept
+    : bytes(std::move(b.bytes)), bits(b.bits) {
+  b.bits = 0;
+}
+
+AtomicBitArray &AtomicBitArray::operator=(AtomicBitArray &&b) noexcept {
+  if (this != &b) {
+    bytes = std::move(b.bytes);
+    bits = b.bits;
+    b.bits = 0;
+  }
+
+  return *this;
+}
+
+bool AtomicBitArray::test_and_set(size_t n, std::memory_order order) {
+  check(n, "Unable to test and set: n is out of range");
+
+  const byte_type mask = 1UL << (n % BitArray::byte_bits);
+  return bytes[n / BitArray::byte_bits].fetch_or(mask, order) & mask;
+}
+
+bool AtomicBitArray::test_and_reset(size_t n, std::memory_order order) {
+  check(n, "Unable to test and reset: n is out of range");
+
+  const byte_type mask = 1UL << (n % BitArray::byte_bits);
+  return bytes[n / BitArray::byte_bits].fetch_and(~mask, order) & mask;
+}
+
+AtomicBitArray &AtomicBitArray::set(size_t n, bool val,
+                                    std::memory_order order) {
+  if (val) {
+    test_and_set(n, order);
+  } else {
+    test_and_reset(n, order);
+  }
+
+  return *this;
+}
+
+AtomicBitArray &AtomicBitArray::reset(size_t n, std::memory_order order) {
+  test_and_reset(n, order);
+  return *this;
+}
+
+AtomicBitArray &AtomicBitArray::reset() {
+  for (size_t i = 0; i < byte_count(); i++) {
+    bytes[i].store(0, std::memory_order_relaxed);
+  }
+
+  std::atomic_thread_fence(std::memory_order_release);
+
+  return *this;
+}
+
+bool AtomicBitArray::get(size_t i, std::memory_order order) const {
+  check(i, "Unable to get: i is out of range");
+
+  return (bytes[i / BitArray::byte_bits].load(order) >>
+          (i % BitArray::byte_bits)) &
+         1UL;
+}
+
+bool AtomicBitArray::operator[](size_t i) const { return get(i); }
+
+byte_type AtomicBitArray::fetch_or_word(size_t i, byte_type mask,
+                                        std::memory_order order) {
+  if (i >= byte_count()) {
+    throw std::out_of_range("Unable to fetch or: i is out of range");
+  }
+
+  return bytes[i].fetch_or(mask & byte_mask(i), order);
+}
+
+byte_type AtomicBitArray::fetch_and_word(size_t i, byte_type mask,
+                                         std::memory_order order) {
+  if (i >= byte_count()) {
+    throw std::out_of_range("Unable to fetch and: i is out of range");
+  }
+
+  return bytes[i].fetch_and(mask, order);
+}
+
+size_t AtomicBitArray::count() const {
+  size_t ones = 0;
+
+  for (size_t i = 0; i < byte_count(); i++) {
+    ones += __builtin_popcountl(bytes[i].load(std::memory_order_relaxed));
+  }
+
+  return ones;
+}
+
+bool AtomicBitArray::any() const {
+  for (size_t i = 0; i < byte_count(); i++) {
+    if (bytes[i].load(std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool AtomicBitArray::none() const { return !any(); }
+
+BitArray AtomicBitArray::to_bit_array() const { return BitArray(*this); }
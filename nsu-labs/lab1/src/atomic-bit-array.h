@@ -0,0 +1,98 @@
+#ifndef ATOMIC_BIT_ARRAY
+#define ATOMIC_BIT_ARRAY
+
+#include "bit-array.h"
+#include <atomic>
+#include <memory>
+
+// Bit array of fixed size, which bits can be changed by many threads
+// without locks
+// Every operation on a single bit or byte is atomic, operations over the
+// whole array are not a snapshot, if other threads write at the same time
+class AtomicBitArray : public BitExpr<AtomicBitArray> {
+private:
+  std::unique_ptr<std::atomic<byte_type>[]> bytes;
+  size_t bits;
+
+  static size_t to_bytes(size_t bits);
+
+  size_t byte_count() const { return to_bytes(bits); }
+
+  // Bits of the byte, which belong to the array
+  byte_type byte_mask(size_t i) const;
+
+  void check(size_t n, const char *msg) const;
+
+public:
+  static constexpr size_t npos = BitArray::npos;
+
+  AtomicBitArray();
+
+  // Construct array of 0's, with specified amount of bits
+  explicit AtomicBitArray(size_t num_bits);
+
+  // Copy bits of bit array
+  explicit AtomicBitArray(const BitArray &b);
+
+  AtomicBitArray(AtomicBitArray &&b) noexcept;
+  AtomicBitArray &operator=(AtomicBitArray &&b) noexcept;
+
+  // Set n'th bit to 1 (0), return its previous value
+  bool test_and_set(size_t n,
+                    std::memory_order order = std::memory_order_seq_cst);
+  bool test_and_reset(size_t n,
+                      std::memory_order order = std::memory_order_seq_cst);
+
+  // Set n'th bit to 'value'
+  AtomicBitArray &set(size_t n, bool val = true,
+                      std::memory_order order = std::memory_order_seq_cst);
+
+  // Set n'th bit to 0
+  AtomicBitArray &reset(size_t n,
+                        std::memory_order order = std::memory_order_seq_cst);
+
+  // Fill array with 0's, bytes are cleared one by one
+  AtomicBitArray &reset();
+
+  // Return i'th bit value
+  bool get(size_t i, std::memory_order order = std::memory_order_seq_cst) const;
+  bool operator[](size_t i) const;
+
+  // i'th byte (word of byte_type) |= mask (&= mask), return its previous
+  // value
+  // Bits outside of the array are dropped from the mask
+  byte_type fetch_or_word(size_t i, byte_type mask,
+                          std::memory_order order = std::memory_order_seq_cst);
+  byte_type fetch_and_word(size_t i, byte_type mask,
+                           std::memory_order order = std::memory_order_seq_cst);
+
+  // Count bits of value 1 with relaxed loads
+  // Exact only if no other thread changes the array
+  size_t count() const;
+
+  // True, if at least one bit of value 1 (relaxed loads)
+  bool any() const;
+
+  // True, if all bits are 0's (relaxed loads)
+  bool none() const;
+
+  size_t size() const { return bits; }
+  bool empty() const { return bits == 0; }
+
+  // Return i'th byte (relaxed load by default), 0 if it is out of range
+  byte_type byte(size_t i,
+                 std::memory_order order = std::memory_order_relaxed) const {
+    return i < byte_count() ? bytes[i].load(order) : 0;
+  }
+
+  // Copy bits into a bit array, same as BitArray(*this)
+  BitArray to_bit_array() const;
+};
+
+// Atomic arrays are used in expressions by reference, like bit arrays
+template <> struct BitExprTraits<AtomicBitArray> {
+  using store = const AtomicBitArray &;
+  static constexpr bool elementwise = true;
+};
+
+#endif
@@ -0,0 +1,346 @@
+#include "bit-array-index.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+
+constexpr int byte_bits = BitArray::byte_bits;
+
+// Distances of so many blocks are computed by one kernel call
+constexpr size_t scan_blocks = 256;
+
+// Hash lookup of a chunk and check of its vectors take about as long, as
+// scan of so many vectors
+constexpr double lookup_cost = 128;
+
+using Match = BitArrayIndex::Match;
+
+// Up to k best matches, the worst one on top
+class TopK {
+private:
+  std::priority_queue<Match> heap;
+  size_t k;
+
+public:
+  explicit TopK(size_t k) : k(k) {}
+
+  bool full() const { return heap.size() == k; }
+
+  // Distance, which a match must not exceed to get in
+  size_t bound() const { return full() ? heap.top().distance : size_t(-1); }
+
+  void offer(size_t id, size_t distance) {
+    const Match m{id, distance};
+
+    if (!full()) {
+      heap.push(m);
+    } else if (m < heap.top()) {
+      heap.pop();
+      heap.push(m);
+    }
+  }
+
+  // Matches, closer first
+  std::vector<Match> take() {
+    std::vector<Match> matches(heap.size());
+
+    for (size_t i = matches.size(); i-- > 0; heap.pop()) {
+      matches[i] = heap.top();
+    }
+
+    return matches;
+  }
+};
+
+// Ids, which a query has checked
+// Bitmap of every thread is kept between queries, and only bits of checked
+// ids are cleared, so a query takes no time for ids, which it doesn't check
+class SeenIds {
+private:
+  BitArray &marks;
+  std::vector<size_t> ids;
+
+  static BitArray &thread_marks() {
+    thread_local BitArray marks;
+    return marks;
+  }
+
+public:
+  explicit SeenIds(size_t size) : marks(thread_marks()) {
+    if (marks.size() < size) {
+      marks.resize(size);
+    }
+  }
+
+  SeenIds(const SeenIds &) = delete;
+  SeenIds &operator=(const SeenIds &) = delete;
+
+  ~SeenIds() {
+    for (const size_t id : ids) {
+      marks.reset(id);
+    }
+  }
+
+  size_t size() const { return ids.size(); }
+
+  // False, if id is already checked
+  bool insert(size_t id) {
+    if (marks[id]) {
+      return false;
+    }
+
+    marks.set(id);
+    ids.push_back(id);
+    return true;
+  }
+};
+
+// Number of values of 'bits' bits at distance 's' from a value
+double binomial(int bits, int s) {
+  double c = s > bits ? 0 : 1;
+
+  // Not lgamma(), which writes global signgam in many threads
+  for (int i = 1; i <= s && i <= bits; i++) {
+    c = c * (bits - s + i) / i;
+  }
+
+  return c;
+}
+
+} // namespace
+
+void BitArrayIndex::check_query(const BitArray &query) const {
+  if (query.size() != bits) {
+    throw std::invalid_argument("Vector must have the width of the index");
+  }
+}
+
+uint64_t BitArrayIndex::chunk(const ConstBitSpan &vector, size_t c) const {
+  return vector.subspan(chunk_begin(c), chunk_bits(c)).byte(0);
+}
+
+void BitArrayIndex::insert_chunks(size_t id, const ConstBitSpan &vector) {
+  for (size_t c = 0; c < tables.size(); c++) {
+    tables[c][chunk(vector, c)].push_back(id);
+  }
+}
+
+BitArrayIndex::BitArrayIndex(size_t width)
+    : bits(width), words((width + byte_bits - 1) / byte_bits), len(0) {
+  if (width == 0) {
+    throw std::invalid_argument("Width of vectors must be positive");
+  }
+}
+
+BitArrayIndex::BitArrayIndex(const std::vector<BitArray> &vectors)
+    : BitArrayIndex(vectors.empty() ? 0 : vectors[0].size()) {
+  bytes.reserve((vectors.size() + lanes - 1) / lanes * block_words());
+
+  for (const BitArray &vector : vectors) {
+    add(vector);
+  }
+}
+
+size_t BitArrayIndex::add(const BitArray &vector) {
+  check_query(vector);
+
+  // New block is filled with zero vectors, which are never reported
+  if (len % lanes == 0) {
+    bytes.resize(bytes.size() + block_words());
+  }
+
+  const size_t id = len;
+  byte_type *block = bytes.data() + id / lanes * block_words();
+
+  for (size_t j = 0; j < words; j++) {
+    block[j * lanes + id % lanes] = vector.data()[j];
+  }
+
+  insert_chunks(id, vector);
+  len++;
+
+  return id;
+}
+
+BitArray BitArrayIndex::get(size_t id) const {
+  if (id >= len) {
+    throw std::out_of_range("Unable to get: id is out of range");
+  }
+
+  std::vector<byte_type> vector(words);
+  for (size_t j = 0; j < words; j++) {
+    vector[j] = word(id, j);
+  }
+
+  return BitArray(ConstBitSpan(vector.data(), 0, bits));
+}
+
+size_t BitArrayIndex::distance(size_t id, const BitArray &query) const {
+  if (id >= len) {
+    throw std::out_of_range("Unable to compare: id is out of range");
+  }
+  check_query(query);
+
+  // Whole block is compared, it takes as long as one vector
+  uint32_t distances[lanes];
+  BitKernels::hamming(bytes.data() + id / lanes * block_words(), words,
+                      query.data(), distances, 1);
+
+  return distances[id % lanes];
+}
+
+void BitArrayIndex::build_multi_index(size_t chunks) {
+  if (chunks == 0) {
+    // Chunks of log2(size) bits give about one vector per chunk value
+    const int chunk = std::clamp<int>(std::log2(std::max<size_t>(len, 1)), 8,
+                                      max_chunk_bits);
+    chunks = (bits + chunk - 1) / chunk;
+  }
+
+  if (chunks > bits || (bits + chunks - 1) / chunks > max_chunk_bits) {
+    throw std::invalid_argument(
+        "Chunks of multi-index must have from 1 to 32 bits");
+  }
+
+  tables.assign(chunks, {});
+
+  for (size_t id = 0; id < len; id++) {
+    insert_chunks(id, get(id));
+  }
+}
+
+void BitArrayIndex::drop_multi_index() { tables.clear(); }
+
+std::vector<Match> BitArrayIndex::search_linear(const BitArray &query,
+                                                size_t k) const {
+  const size_t blocks = (len + lanes - 1) / lanes;
+  std::vector<uint32_t> distances(scan_blocks * lanes);
+  TopK top(k);
+
+  for (size_t begin = 0; begin < blocks; begin += scan_blocks) {
+    const size_t count = std::min(scan_blocks, blocks - begin);
+    BitKernels::hamming(bytes.data() + begin * block_words(), words,
+                        query.data(), distances.data(), count);
+
+    const size_t first = begin * lanes;
+    const size_t last = std::min(len, first + count * lanes);
+    size_t bound = top.bound();
+
+    for (size_t id = first; id < last; id++) {
+      if (distances[id - first] <= bound) {
+        top.offer(id, distances[id - first]);
+        bound = top.bound();
+      }
+    }
+  }
+
+  return top.take();
+}
+
+std::vector<Match> BitArrayIndex::search_multi_index(const BitArray &query,
+                                                     size_t k) const {
+  const size_t chunks = tables.size();
+  const int widest = (bits + chunks - 1) / chunks;
+
+  std::vector<uint64_t> query_chunks(chunks);
+  for (size_t c = 0; c < chunks; c++) {
+    query_chunks[c] = chunk(query, c);
+  }
+
+  SeenIds seen(len);
+  double lookups = 0;
+  uint32_t distances[lanes];
+  TopK top(k);
+
+  for (int s = 0; s <= widest && seen.size() < len; s++) {
+    // Vectors, which are not seen, differ in at least s bits of every chunk
+    if (top.full() && top.bound() < chunks * s) {
+      break;
+    }
+
+    // Far neighbours are found faster by the scan, than by lookups of all
+    // chunk values at distance s
+    for (size_t c = 0; c < chunks; c++) {
+      lookups += binomial(chunk_bits(c), s);
+    }
+    if (lookups * lookup_cost > len) {
+      return search_linear(query, k);
+    }
+
+    for (size_t c = 0; c < chunks; c++) {
+      const int b = chunk_bits(c);
+      if (s > b) {
+        continue;
+      }
+
+      // Masks of s bits of b in increasing order
+      const uint64_t end = 1UL << b;
+      for (uint64_t mask = (1UL << s) - 1; mask < end;) {
+        const auto it = tables[c].find(query_chunks[c] ^ mask);
+
+        if (it != tables[c].end()) {
+          for (const size_t id : it->second) {
+            if (!seen.insert(id)) {
+              continue;
+            }
+
+            BitKernels::hamming(bytes.data() + id / lanes * block_words(),
+                                words, query.data(), distances, 1);
+            top.offer(id, distances[id % lanes]);
+          }
+        }
+
+        if (mask == 0) {
+          break;
+        }
+
+        // Next mask with the same number of bits
+        const uint64_t low = mask & -mask;
+        const uint64_t ripple = mask + low;
+        mask = ripple | (((mask ^ ripple) >> 2) / low);
+      }
+    }
+  }
+
+  return top.take();
+}
+
+std::vector<Match> BitArrayIndex::search(const BitArray &query,
+                                         size_t k) const {
+  check_query(query);
+
+  if (k == 0 || len == 0) {
+    return {};
+  }
+
+  return tables.empty() ? search_linear(query, k)
+                        : search_multi_index(query, k);
+}
+
+std::vector<std::vector<Match>>
+BitArrayIndex::search_batch(const std::vector<BitArray> &queries,
+                            size_t k) const {
+  for (const BitArray &query : queries) {
+    check_query(query);
+  }
+
+  std::vector<std::vector<Match>> results(queries.size());
+
+  // Queries are parallel, if they scan as many words as large arrays
+  const size_t scan_words = std::max<size_t>(len * words, 1);
+  const size_t threshold =
+      std::max<size_t>(BitKernels::parallel_threshold() / scan_words, 1);
+
+  BitKernels::for_each_part(
+      queries.size(),
+      [&](size_t begin, size_t end) {
+        for (size_t q = begin; q < end; q++) {
+          results[q] = search(queries[q], k);
+        }
+      },
+      threshold);
+
+  return results;
+}
@@ -0,0 +1,120 @@
+#ifndef BIT_ARRAY_INDEX
+#define BIT_ARRAY_INDEX
+
+#include "bit-array.h"
+#include "byte-storage.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Collection of bit vectors of the same width for nearest neighbour search
+// by Hamming distance
+// Vectors are kept in one buffer by blocks of BitKernels::hamming_lanes
+// vectors, word by word (word j of all vectors of a block is contiguous), so
+// a scan compares the query with a whole block by vector instructions.
+// Multi-index hashing splits vectors into chunks and hashes every chunk.
+// A vector within distance d of the query has a chunk within d / chunks of
+// the query chunk, so search looks up chunks at growing distance and stops,
+// when vectors, which are not found yet, can't be closer.
+// Const operations may run in many threads at once. Multi-index search
+// keeps a bitmap of size() bits in every thread, which uses it.
+class BitArrayIndex {
+public:
+  struct Match {
+    size_t id;
+    size_t distance;
+
+    friend bool operator==(const Match &a, const Match &b) {
+      return a.id == b.id && a.distance == b.distance;
+    }
+    friend bool operator!=(const Match &a, const Match &b) { return !(a == b); }
+
+    // Closer first, then lower id
+    friend bool operator<(const Match &a, const Match &b) {
+      return a.distance != b.distance ? a.distance < b.distance : a.id < b.id;
+    }
+  };
+
+  // Chunks of multi-index hashing are at most so wide
+  static constexpr int max_chunk_bits = 32;
+
+private:
+  static constexpr size_t lanes = BitKernels::hamming_lanes;
+
+  ByteStorage bytes;
+  size_t bits;
+  size_t words;
+  size_t len;
+
+  // Chunk values of every chunk to ids, empty if there is no multi-index
+  std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> tables;
+
+  size_t block_words() const { return words * lanes; }
+
+  // j'th word of vector id
+  byte_type word(size_t id, size_t j) const {
+    return bytes[id / lanes * block_words() + j * lanes + id % lanes];
+  }
+
+  void check_query(const BitArray &query) const;
+
+  // Position and width of c'th chunk
+  size_t chunk_begin(size_t c) const { return c * bits / tables.size(); }
+  int chunk_bits(size_t c) const {
+    return chunk_begin(c + 1) - chunk_begin(c);
+  }
+
+  uint64_t chunk(const ConstBitSpan &vector, size_t c) const;
+  void insert_chunks(size_t id, const ConstBitSpan &vector);
+
+  std::vector<Match> search_linear(const BitArray &query, size_t k) const;
+  std::vector<Match> search_multi_index(const BitArray &query,
+                                        size_t k) const;
+
+public:
+  // Empty collection of vectors of 'width' bits
+  // Throws std::invalid_argument, if width is 0
+  explicit BitArrayIndex(size_t width);
+
+  // Collection of the vectors, throws std::invalid_argument if widths
+  // differ or vectors is empty
+  explicit BitArrayIndex(const std::vector<BitArray> &vectors);
+
+  size_t width() const { return bits; }
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+
+  // Add vector of the width and return its id, ids are 0, 1, 2, ...
+  // Throws std::invalid_argument, if width differs
+  size_t add(const BitArray &vector);
+
+  // Copy of the vector, throws std::out_of_range
+  BitArray get(size_t id) const;
+
+  // Hamming distance between the vector and query
+  // Throws std::out_of_range, std::invalid_argument if width differs
+  size_t distance(size_t id, const BitArray &query) const;
+
+  // Build multi-index of 'chunks' chunks, 0 picks chunks of about
+  // log2(size) bits. Added vectors are indexed too
+  // Throws std::invalid_argument, if chunks are wider than max_chunk_bits or
+  // there are more chunks than bits
+  void build_multi_index(size_t chunks = 0);
+  void drop_multi_index();
+
+  // Number of chunks of multi-index, 0 if there is none
+  size_t multi_index_chunks() const { return tables.size(); }
+
+  // Up to k nearest vectors, closer first, ties by lower id
+  // Multi-index is used, if it is built, and gives the same result
+  // Throws std::invalid_argument, if width differs
+  std::vector<Match> search(const BitArray &query, size_t k) const;
+
+  // search() of every query, queries are split between BitKernels::threads()
+  // threads, if there is enough work
+  std::vector<std::vector<Match>>
+  search_batch(const std::vector<BitArray> &queries, size_t k) const;
+};
+
+#endif
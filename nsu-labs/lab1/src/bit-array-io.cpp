@@ -0,0 +1,291 @@
+// Binary serialization of BitArray
+
+#include "bit-array.h"
+#include <algorithm>
+#include <cerrno>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+
+// Magics are "BITARRAY" and "BITARWAH" in little-endian order, raw header
+// is the header of MappedBitArray files
+constexpr uint64_t raw_magic = 0x5941525241544942;
+constexpr uint64_t wah_magic = 0x4841575241544942;
+
+// Marker of word-aligned hybrid code:
+// bit 63 - value of run words, bits [32, 63) - run length,
+// bits [0, 32) - number of literal words after the marker
+constexpr uint64_t max_run = (1UL << 31) - 1;
+constexpr uint64_t max_literals = (1UL << 32) - 1;
+
+// Words are converted in chunks on big-endian hosts
+constexpr size_t chunk_words = 4096;
+
+// Array grows by so many words as they are read, so a corrupted size in
+// the header doesn't allocate memory for words, which aren't there
+constexpr size_t read_chunk_words = 1 << 16;
+
+constexpr bool little_endian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+uint64_t to_le(uint64_t word) {
+  return little_endian ? word : __builtin_bswap64(word);
+}
+
+// Sinks and sources write and read exactly 'size' bytes or throw
+
+class StreamSink {
+private:
+  std::ostream &out;
+
+public:
+  explicit StreamSink(std::ostream &out) : out(out) {}
+
+  void write(const void *data, size_t size) {
+    if (!out.write(static_cast<const char *>(data), size)) {
+      throw std::runtime_error("Unable to write bit array to stream");
+    }
+  }
+};
+
+class FdSink {
+private:
+  int fd;
+
+public:
+  explicit FdSink(int fd) : fd(fd) {}
+
+  void write(const void *data, size_t size) {
+    const char *ptr = static_cast<const char *>(data);
+
+    while (size > 0) {
+      const ssize_t n = ::write(fd, ptr, size);
+
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to write bit array");
+      }
+
+      ptr += n;
+      size -= n;
+    }
+  }
+};
+
+class StreamSource {
+private:
+  std::istream &in;
+
+public:
+  explicit StreamSource(std::istream &in) : in(in) {}
+
+  void read(void *data, size_t size) {
+    if (!in.read(static_cast<char *>(data), size)) {
+      throw std::runtime_error("Bit array stream is truncated");
+    }
+  }
+};
+
+class FdSource {
+private:
+  int fd;
+
+public:
+  explicit FdSource(int fd) : fd(fd) {}
+
+  void read(void *data, size_t size) {
+    char *ptr = static_cast<char *>(data);
+
+    while (size > 0) {
+      const ssize_t n = ::read(fd, ptr, size);
+
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to read bit array");
+      }
+      if (n == 0) {
+        throw std::runtime_error("Bit array file is truncated");
+      }
+
+      ptr += n;
+      size -= n;
+    }
+  }
+};
+
+template <class Sink> void write_word(Sink &sink, uint64_t word) {
+  word = to_le(word);
+  sink.write(&word, sizeof(word));
+}
+
+template <class Source> uint64_t read_word(Source &source) {
+  uint64_t word;
+  source.read(&word, sizeof(word));
+  return to_le(word);
+}
+
+template <class Sink>
+void write_words(Sink &sink, const byte_type *words, size_t size) {
+  if (little_endian) {
+    sink.write(words, size * sizeof(byte_type));
+    return;
+  }
+
+  uint64_t chunk[chunk_words];
+
+  for (size_t i = 0; i < size; i += chunk_words) {
+    const size_t n = std::min(chunk_words, size - i);
+
+    for (size_t j = 0; j < n; j++) {
+      chunk[j] = to_le(words[i + j]);
+    }
+
+    sink.write(chunk, n * sizeof(uint64_t));
+  }
+}
+
+template <class Source>
+void read_words(Source &source, byte_type *words, size_t size) {
+  source.read(words, size * sizeof(byte_type));
+
+  if (!little_endian) {
+    for (size_t i = 0; i < size; i++) {
+      words[i] = to_le(words[i]);
+    }
+  }
+}
+
+template <class Sink>
+void write_wah(Sink &sink, const byte_type *words, size_t size) {
+  const auto clean = [](byte_type word) { return word == 0 || word == ~0UL; };
+
+  for (size_t i = 0; i < size;) {
+    const byte_type fill = clean(words[i]) ? words[i] : 0;
+    size_t run = 0;
+
+    while (i < size && words[i] == fill && run < max_run) {
+      i++;
+      run++;
+    }
+
+    const size_t literal_begin = i;
+
+    while (i < size && !clean(words[i]) && i - literal_begin < max_literals) {
+      i++;
+    }
+
+    const size_t literals = i - literal_begin;
+
+    write_word(sink, ((fill & 1UL) << 63) | (run << 32) | literals);
+    write_words(sink, words + literal_begin, literals);
+  }
+}
+
+// Read 'size' words to the end of bytes
+template <class Source>
+void append_words(Source &source, ByteStorage &bytes, size_t size) {
+  for (size_t i = 0; i < size; i += read_chunk_words) {
+    const size_t n = std::min(read_chunk_words, size - i);
+    const size_t end = bytes.size();
+
+    bytes.resize(end + n);
+    read_words(source, bytes.data() + end, n);
+  }
+}
+
+template <class Source>
+void read_wah(Source &source, ByteStorage &bytes, size_t size) {
+  while (bytes.size() < size) {
+    const size_t i = bytes.size();
+    const uint64_t marker = read_word(source);
+    const byte_type fill = marker >> 63 ? ~0UL : 0;
+    const size_t run = (marker >> 32) & max_run;
+    const size_t literals = marker & max_literals;
+
+    if (run > size - i || literals > size - i - run) {
+      throw std::runtime_error("Bit array code is corrupted");
+    }
+
+    // New words are 0
+    bytes.resize(i + run);
+    if (fill) {
+      BitKernels::fill(bytes.data() + i, run, fill);
+    }
+
+    append_words(source, bytes, literals);
+  }
+}
+
+template <class Sink>
+void write(Sink &sink, const BitArray &b, BitArray::Format format) {
+  const bool raw = format == BitArray::Format::raw;
+
+  write_word(sink, raw ? raw_magic : wah_magic);
+  write_word(sink, b.size());
+
+  if (raw) {
+    write_words(sink, b.data(), b.byte_count());
+  } else {
+    write_wah(sink, b.data(), b.byte_count());
+  }
+}
+
+} // namespace
+
+template <class Source> BitArray BitArray::read(Source &source) {
+  const uint64_t magic = read_word(source);
+
+  if (magic != raw_magic && magic != wah_magic) {
+    throw std::runtime_error("Not a serialized bit array");
+  }
+
+  const uint64_t num_bits = read_word(source);
+
+  if (num_bits > max_size()) {
+    throw std::runtime_error("Bit array size is corrupted");
+  }
+
+  BitArray b;
+
+  if (magic == raw_magic) {
+    append_words(source, b.bytes, to_bytes(num_bits));
+  } else {
+    read_wah(source, b.bytes, to_bytes(num_bits));
+  }
+
+  b.bits = num_bits;
+
+  // Unused bits may be set in corrupted input
+  b.trim();
+
+  return b;
+}
+
+void BitArray::serialize(std::ostream &out, Format format) const {
+  StreamSink sink(out);
+  write(sink, *this, format);
+}
+
+void BitArray::serialize(int fd, Format format) const {
+  FdSink sink(fd);
+  write(sink, *this, format);
+}
+
+BitArray BitArray::deserialize(std::istream &in) {
+  StreamSource source(in);
+  return read(source);
+}
+
+BitArray BitArray::deserialize(int fd) {
+  FdSource source(fd);
+  return read(source);
+}
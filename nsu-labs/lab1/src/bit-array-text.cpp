@@ -0,0 +1,405 @@
+// Text conversions of BitArray
+
+#include "bit-array.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr int byte_bits = BitArray::byte_bits;
+
+constexpr bool little_endian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+constexpr char hex_digits[] = "0123456789abcdef";
+constexpr char hex_upper_digits[] = "0123456789ABCDEF";
+constexpr char base64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Lookup tables, built at compile time
+struct Tables {
+  // 8 chars of a byte, the high bit first
+  char binary[256][8];
+  // 2 hex digits of a byte
+  char hex[256][2];
+  // Values of digits, -1 for other chars
+  signed char hex_value[256];
+  signed char base64_value[256];
+
+  constexpr Tables() : binary(), hex(), hex_value(), base64_value() {
+    for (int b = 0; b < 256; b++) {
+      for (int j = 0; j < 8; j++) {
+        binary[b][j] = '0' + ((b >> (7 - j)) & 1);
+      }
+
+      hex[b][0] = hex_digits[b >> 4];
+      hex[b][1] = hex_digits[b & 15];
+      hex_value[b] = -1;
+      base64_value[b] = -1;
+    }
+
+    for (int d = 0; d < 16; d++) {
+      hex_value[static_cast<unsigned char>(hex_digits[d])] = d;
+      hex_value[static_cast<unsigned char>(hex_upper_digits[d])] = d;
+    }
+
+    for (int d = 0; d < 64; d++) {
+      base64_value[static_cast<unsigned char>(base64_digits[d])] = d;
+    }
+  }
+};
+
+constexpr Tables tables;
+
+// Every byte of 8 chars is '0' or '1' after xor with ascii_zeros
+constexpr uint64_t ascii_zeros = 0x3030303030303030;
+constexpr uint64_t low_bits = 0x0101010101010101;
+
+// Multiplication moves bit 0 of byte t to bit 63 - t, so the first char
+// becomes the high bit of the top byte
+constexpr uint64_t gather_bits = 0x8040201008040201;
+
+size_t to_bytes(size_t bits) { return (bits + byte_bits - 1) / byte_bits; }
+
+// i'th 8-bit byte of little-endian image of words
+uint8_t octet(const byte_type *words, size_t i) {
+  return words[i / 8] >> (i % 8 * 8);
+}
+
+// Writers fill text of 'bits' bits of words, the last word first. Its
+// unused bits are 0, so it is written whole into a local buffer and only
+// the used tail is copied
+
+void binary_word(byte_type word, char *out) {
+  for (int j = 0; j < 8; j++) {
+    std::memcpy(out + 8 * j, tables.binary[(word >> (56 - 8 * j)) & 0xff], 8);
+  }
+}
+
+void write_binary(const byte_type *words, size_t bits, char *out) {
+  const size_t full = bits / byte_bits;
+  const int rest = bits % byte_bits;
+
+  if (rest > 0) {
+    char word[byte_bits];
+    binary_word(words[full], word);
+    std::memcpy(out, word + byte_bits - rest, rest);
+    out += rest;
+  }
+
+  for (size_t i = full; i-- > 0; out += byte_bits) {
+    binary_word(words[i], out);
+  }
+}
+
+void hex_word(byte_type word, char *out) {
+  for (int j = 0; j < 8; j++) {
+    std::memcpy(out + 2 * j, tables.hex[(word >> (56 - 8 * j)) & 0xff], 2);
+  }
+}
+
+void write_hex(const byte_type *words, size_t bits, char *out) {
+  constexpr int word_digits = byte_bits / 4;
+
+  const size_t full = bits / byte_bits;
+  const int rest = (bits % byte_bits + 3) / 4;
+
+  if (rest > 0) {
+    char word[word_digits];
+    hex_word(words[full], word);
+    std::memcpy(out, word + word_digits - rest, rest);
+    out += rest;
+  }
+
+  for (size_t i = full; i-- > 0; out += word_digits) {
+    hex_word(words[i], out);
+  }
+}
+
+void write_base64(const byte_type *words, size_t bits, char *out) {
+  const size_t size = (bits + 7) / 8;
+  size_t i = 0;
+
+  // 6 bytes are 8 digits, little-endian words are read as memory
+  if (little_endian) {
+    const char *image = reinterpret_cast<const char *>(words);
+    const size_t readable = to_bytes(bits) * sizeof(byte_type);
+
+    for (; i + 8 <= readable && i + 6 <= size; i += 6, out += 8) {
+      uint64_t group;
+      std::memcpy(&group, image + i, sizeof(group));
+      group = __builtin_bswap64(group);
+
+      for (int j = 0; j < 8; j++) {
+        out[j] = base64_digits[(group >> (58 - 6 * j)) & 63];
+      }
+    }
+  }
+
+  // 3 bytes are 4 digits
+  for (; i + 3 <= size; i += 3, out += 4) {
+    const uint32_t group = octet(words, i) << 16 | octet(words, i + 1) << 8 |
+                           octet(words, i + 2);
+
+    out[0] = base64_digits[group >> 18];
+    out[1] = base64_digits[(group >> 12) & 63];
+    out[2] = base64_digits[(group >> 6) & 63];
+    out[3] = base64_digits[group & 63];
+  }
+
+  if (i < size) {
+    const bool two = i + 1 < size;
+    const uint32_t group =
+        octet(words, i) << 16 | (two ? octet(words, i + 1) << 8 : 0);
+
+    out[0] = base64_digits[group >> 18];
+    out[1] = base64_digits[(group >> 12) & 63];
+    out[2] = two ? base64_digits[(group >> 6) & 63] : '=';
+    out[3] = '=';
+  }
+}
+
+// Checkers return false, if text of 'size' chars has a wrong char. Text
+// is checked before it is read, so malformed text leaves the array as it
+// was, and chars are checked by whole words, not char by char
+
+bool check_binary(const char *text, size_t size) {
+  uint64_t bad = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= size; i += 8) {
+    uint64_t chars;
+    std::memcpy(&chars, text + i, sizeof(chars));
+    bad |= (chars ^ ascii_zeros) & ~low_bits;
+  }
+
+  for (; i < size; i++) {
+    bad |= (text[i] ^ '0') & ~1;
+  }
+
+  return bad == 0;
+}
+
+// Text of hex digits or of base64 digits
+bool check_digits(const char *text, size_t size,
+                  const signed char (&values)[256]) {
+  int bad = 0;
+
+  for (size_t i = 0; i < size; i++) {
+    bad |= values[static_cast<unsigned char>(text[i])];
+  }
+
+  return bad >= 0;
+}
+
+// Readers fill words from checked text of 'bits' bits
+
+// Byte of 8 binary chars, the first char is the high bit
+byte_type parse_binary_byte(const char *text) {
+  uint64_t chars;
+  std::memcpy(&chars, text, sizeof(chars));
+
+  if (!little_endian) {
+    chars = __builtin_bswap64(chars);
+  }
+
+  return ((chars ^ ascii_zeros) * gather_bits) >> 56;
+}
+
+void read_binary(const char *text, size_t bits, byte_type *words) {
+  const size_t full = bits / byte_bits;
+  const int rest = bits % byte_bits;
+
+  if (rest > 0) {
+    byte_type word = 0;
+
+    for (int j = 0; j < rest; j++) {
+      word = word << 1 | (text[j] - '0');
+    }
+
+    words[full] = word;
+    text += rest;
+  }
+
+  for (size_t i = full; i-- > 0; text += byte_bits) {
+    byte_type word = 0;
+
+    for (int j = 0; j < 8; j++) {
+      word = word << 8 | parse_binary_byte(text + 8 * j);
+    }
+
+    words[i] = word;
+  }
+}
+
+// Word of 'size' hex digits
+byte_type parse_hex_word(const char *text, int size) {
+  byte_type word = 0;
+
+  for (int j = 0; j < size; j++) {
+    word = word << 4 | tables.hex_value[static_cast<unsigned char>(text[j])];
+  }
+
+  return word;
+}
+
+void read_hex(const char *text, size_t bits, byte_type *words) {
+  constexpr int word_digits = byte_bits / 4;
+
+  const size_t full = bits / byte_bits;
+  const int rest = bits % byte_bits / 4;
+
+  if (rest > 0) {
+    words[full] = parse_hex_word(text, rest);
+    text += rest;
+  }
+
+  for (size_t i = full; i-- > 0; text += word_digits) {
+    words[i] = parse_hex_word(text, word_digits);
+  }
+}
+
+void read_base64(const char *text, size_t bits, byte_type *words) {
+  const size_t size = bits / 8;
+
+  size_t i = 0;
+
+  BitKernels::fill(words, to_bytes(bits), 0);
+
+  // 8 digits are 6 bytes, the last group may have padding
+  if (little_endian) {
+    char *image = reinterpret_cast<char *>(words);
+
+    for (; i + 6 < size; i += 6, text += 8) {
+      uint64_t group = 0;
+
+      for (int j = 0; j < 8; j++) {
+        group = group << 6 |
+                tables.base64_value[static_cast<unsigned char>(text[j])];
+      }
+
+      group = __builtin_bswap64(group << 16);
+      std::memcpy(image + i, &group, 6);
+    }
+  }
+
+  for (; i < size; i += 3, text += 4) {
+    uint32_t group = 0;
+
+    // Padding is only after the last byte
+    for (size_t j = 0; j < 4; j++) {
+      const bool pad = i + j > size;
+      group = group << 6 |
+              (pad ? 0 : tables.base64_value[static_cast<unsigned char>(
+                             text[j])]);
+    }
+
+    for (size_t j = 0; j < 3 && i + j < size; j++) {
+      const byte_type byte = (group >> (16 - 8 * j)) & 0xff;
+      words[(i + j) / 8] |= byte << ((i + j) % 8 * 8);
+    }
+  }
+}
+
+} // namespace
+
+size_t BitArray::text_size(size_t num_bits, TextFormat format) {
+  switch (format) {
+  case TextFormat::binary:
+    return num_bits;
+  case TextFormat::hex:
+    return (num_bits + 3) / 4;
+  case TextFormat::base64:
+    return ((num_bits + 7) / 8 + 2) / 3 * 4;
+  }
+
+  throw std::invalid_argument("Unknown text format");
+}
+
+char *BitArray::to_chars(char *out, size_t size, TextFormat format) const {
+  const size_t length = text_size(bits, format);
+
+  if (size < length) {
+    throw std::invalid_argument("Buffer is too small for text of bit array");
+  }
+
+  switch (format) {
+  case TextFormat::binary:
+    write_binary(bytes.data(), bits, out);
+    break;
+  case TextFormat::hex:
+    write_hex(bytes.data(), bits, out);
+    break;
+  case TextFormat::base64:
+    write_base64(bytes.data(), bits, out);
+    break;
+  }
+
+  return out + length;
+}
+
+BitArray &BitArray::from_chars(const char *text, size_t size,
+                               TextFormat format) {
+  size_t num_bits = size;
+  bool valid = true;
+
+  switch (format) {
+  case TextFormat::binary:
+    valid = check_binary(text, size);
+    break;
+  case TextFormat::hex:
+    num_bits = size * 4;
+    valid = check_digits(text, size, tables.hex_value);
+    break;
+  case TextFormat::base64: {
+    if (size % 4 != 0) {
+      throw std::invalid_argument("Base64 text length must be a multiple of 4");
+    }
+
+    const size_t padding = size == 0                ? 0
+                           : text[size - 1] != '=' ? 0
+                           : text[size - 2] != '=' ? 1
+                                                   : 2;
+    num_bits = (size / 4 * 3 - padding) * 8;
+    valid = check_digits(text, size - padding, tables.base64_value);
+    break;
+  }
+  }
+
+  if (num_bits > max_size()) {
+    throw std::invalid_argument("Text is too long for bit array");
+  }
+
+  if (!valid) {
+    throw std::invalid_argument("Malformed text of bit array");
+  }
+
+  invalidate();
+  bytes.resize(to_bytes(num_bits));
+  bits = num_bits;
+
+  switch (format) {
+  case TextFormat::binary:
+    read_binary(text, bits, bytes.data());
+    break;
+  case TextFormat::hex:
+    read_hex(text, bits, bytes.data());
+    break;
+  case TextFormat::base64:
+    read_base64(text, bits, bytes.data());
+    break;
+  }
+
+  return *this;
+}
+
+std::string BitArray::to_string(TextFormat format) const {
+  std::string str(text_size(bits, format), '\0');
+  to_chars(&str[0], str.size(), format);
+  return str;
+}
+
+BitArray BitArray::from_string(const std::string &text, TextFormat format) {
+  BitArray b;
+  b.from_chars(text.data(), text.size(), format);
+  return b;
+}
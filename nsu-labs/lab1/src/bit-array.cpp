@@ -1,210 +1,650 @@
 #include "bit-array.h"
+#include <algorithm>
 #include <limits>
 #include <stdexcept>
 
 // Private
 
-int BitArray::to_bytes(int bits) {
+size_t BitArray::to_bytes(size_t bits) {
   return bits / byte_bits + (bits % byte_bits ? 1 : 0);
 }
 
+void BitArray::trim() {
+  const int trail = bits % byte_bits;
+
+  if (trail > 0) {
+    bytes.back() &= (1UL << trail) - 1;
+  }
+}
+
+void BitArray::check_range(size_t pos, size_t len, const char *msg) const {
+  if (pos > bits || len > bits - pos) {
+    throw std::out_of_range(msg);
+  }
+}
+
+const BitArray::RankIndex &BitArray::rank_directory() const {
+  RankIndex &index = rank_index;
+
+  if (index.valid) {
+    return index;
+  }
+
+  const size_t size = bytes.size();
+  const size_t blocks = size / RankIndex::block_bytes + 1;
+  // Every superblock starts at a block, so searches never see a superblock
+  // past the last block
+  const size_t superblocks =
+      (blocks + RankIndex::superblock_blocks - 1) / RankIndex::superblock_blocks;
+
+  index.superblocks.assign(superblocks, 0);
+  index.blocks.assign(blocks, 0);
+
+  uint64_t ones = 0;
+
+  for (size_t i = 0; i < blocks; i++) {
+    const size_t superblock = i / RankIndex::superblock_blocks;
+
+    if (i % RankIndex::superblock_blocks == 0) {
+      index.superblocks[superblock] = ones;
+    }
+
+    index.blocks[i] = ones - index.superblocks[superblock];
+
+    const size_t begin = i * RankIndex::block_bytes;
+    if (begin < size) {
+      ones += BitKernels::count(bytes.data() + begin,
+                                std::min(RankIndex::block_bytes, size - begin));
+    }
+  }
+
+  index.ones = ones;
+
+  const size_t superblock_bits =
+      RankIndex::superblock_blocks * RankIndex::block_bytes * byte_bits;
+
+  index.one_samples.clear();
+  index.zero_samples.clear();
+
+  for (size_t sb = 0, next_one = 0, next_zero = 0; sb < superblocks; sb++) {
+    const bool last = sb + 1 == superblocks;
+    const uint64_t end_ones = last ? ones : index.superblocks[sb + 1];
+    const uint64_t end_zeros =
+        last ? bits - ones : (sb + 1) * superblock_bits - end_ones;
+
+    for (; next_one < end_ones; next_one += RankIndex::select_sample) {
+      index.one_samples.push_back(sb);
+    }
+    for (; next_zero < end_zeros; next_zero += RankIndex::select_sample) {
+      index.zero_samples.push_back(sb);
+    }
+  }
+
+  index.valid = true;
+
+  return index;
+}
+
+size_t BitArray::find_from(size_t from, byte_type flip) const {
+  if (from >= bits) {
+    return npos;
+  }
+
+  const size_t size = bytes.size();
+  size_t byte_pos = from / byte_bits;
+
+  // Drop bits before 'from' in the first byte
+  byte_type byte = (bytes[byte_pos] ^ flip) & (~0UL << (from % byte_bits));
+
+  while (!byte && ++byte_pos < size) {
+    byte = bytes[byte_pos] ^ flip;
+  }
+
+  if (!byte) {
+    return npos;
+  }
+
+  const size_t pos = byte_pos * byte_bits + __builtin_ctzl(byte);
+  return pos < bits ? pos : npos;
+}
+
+size_t BitArray::find_to(size_t to, byte_type flip) const {
+  if (to >= bits) {
+    return npos;
+  }
+
+  size_t byte_pos = to / byte_bits;
+  const int bit_pos = to % byte_bits;
+
+  // Drop bits after 'to' in the last byte
+  byte_type byte =
+      (bytes[byte_pos] ^ flip) & (~0UL >> (byte_bits - 1 - bit_pos));
+
+  while (!byte && byte_pos > 0) {
+    byte = bytes[--byte_pos] ^ flip;
+  }
+
+  if (!byte) {
+    return npos;
+  }
+
+  return byte_pos * byte_bits + byte_bits - 1 - __builtin_clzl(byte);
+}
+
+// Count of ones of every 8-bit octet of byte
+static byte_type octet_counts(byte_type byte) {
+  byte = byte - ((byte >> 1) & 0x5555555555555555);
+  byte = (byte & 0x3333333333333333) + ((byte >> 2) & 0x3333333333333333);
+  return (byte + (byte >> 4)) & 0x0f0f0f0f0f0f0f0f;
+}
+
+// k'th one of every 8-bit value
+struct OctetSelectTable {
+  uint8_t pos[256][8];
+
+  constexpr OctetSelectTable() : pos() {
+    for (int b = 0; b < 256; b++) {
+      for (int j = 0, k = 0; j < 8; j++) {
+        if (b >> j & 1) {
+          pos[b][k++] = j;
+        }
+      }
+    }
+  }
+};
+
+static constexpr OctetSelectTable octet_select;
+
+// Position of k'th (starting from 0) bit of value 1 in byte
+// Octet is found by comparison of all prefix sums of octets at once
+static int select_in_byte(byte_type byte, int k) {
+  constexpr byte_type low_octets = 0x0101010101010101;
+  constexpr byte_type high_octets = 0x8080808080808080;
+
+  // Ones up to every octet inclusive
+  const byte_type sums = octet_counts(byte) * low_octets;
+
+  // High bit of octets, where sum is at most k
+  const byte_type below = ((k * low_octets | high_octets) - sums) & high_octets;
+  const int octet = __builtin_popcountl(below) * 8;
+  const int rank = k - (((sums << 8) >> octet) & 0xff);
+
+  return octet + octet_select.pos[(byte >> octet) & 0xff][rank];
+}
+
 // Public
 
 BitArray::BitArray() : bits(0) {}
 
 BitArray::~BitArray() { bytes.clear(); }
 
-BitArray::BitArray(int num_bits, byte_type value) {
-  const int size = to_bytes(num_bits);
-
-  bytes.resize(size);
-  bytes.assign(size, value);
+BitArray::BitArray(size_t num_bits, byte_type value) {
+  bytes.assign(to_bytes(num_bits), value);
 
   bits = num_bits;
+  trim();
+}
+
+BitArray::BitArray(size_t num_bits, byte_type value,
+                   std::pmr::memory_resource *resource)
+    : bytes(to_bytes(num_bits), value, resource), bits(num_bits) {
+  trim();
 }
 
-BitArray::BitArray(const BitArray &b)
-    : bits(b.bits), bytes(std::vector(b.bytes)) {}
+BitArray::BitArray(const BitArray &b) : bytes(b.bytes), bits(b.bits) {}
+
+BitArray::BitArray(const BitArray &b, std::pmr::memory_resource *resource)
+    : bytes(b.bytes, resource), bits(b.bits) {}
+
+BitArray::BitArray(BitArray &&b) noexcept
+    : bytes(std::move(b.bytes)), bits(b.bits) {
+  b.invalidate();
+  b.bits = 0;
+}
 
 void BitArray::swap(BitArray &b) {
+  invalidate();
+  b.invalidate();
+
   bytes.swap(b.bytes);
-  const unsigned int tmp = b.bits;
+  const size_t tmp = b.bits;
   b.bits = bits;
   bits = tmp;
 }
 
-void BitArray::resize(int num_bits, bool value) {
-  if (num_bits < 0) {
-    throw std::invalid_argument("Unable to resize: num_bits is negarive");
+void BitArray::resize(size_t num_bits, bool value) {
+  if (num_bits > max_size()) {
+    throw std::out_of_range("Unable to resize: num_bits is too large");
   }
 
+  invalidate();
+
   if (num_bits == 0) {
     bytes.clear();
-    bytes.resize(0);
     bits = 0;
     return;
   }
 
-  if (num_bits >= std::numeric_limits<int>::max()) {
-    throw std::out_of_range("Unable to resize: num_bits is too large");
-  }
-
-  const int size = to_bytes(num_bits);
+  const size_t size = to_bytes(num_bits);
   if (size != bytes.size()) {
     bytes.resize(size);
   }
 
-  const unsigned int old_bits = bits;
+  const size_t old_bits = bits;
   bits = num_bits;
 
-  if (!value) {
-    return;
+  if (bits < old_bits) {
+    trim();
   }
 
-  for (int i = old_bits; i < bits; i++) {
-    set(i, true);
+  if (value && bits > old_bits) {
+    set_range(old_bits, bits - old_bits);
   }
 }
 
 void BitArray::clear() {
+  invalidate();
   bytes.clear();
   bits = 0;
 }
 
-void BitArray::push_back(bool bit) {
-  resize(bits + 1);
-  set(bits - 1, bit);
+void BitArray::reserve(size_t num_bits) {
+  if (num_bits > max_size()) {
+    throw std::out_of_range("Unable to reserve: num_bits is too large");
+  }
+
+  bytes.reserve(to_bytes(num_bits));
+}
+
+size_t BitArray::capacity() const { return bytes.capacity() * byte_bits; }
+
+void BitArray::push_back(bool bit) { append_bits(bit, 1); }
+
+BitArray &BitArray::append(const BitArray &b) {
+  const size_t pos = bits;
+  const size_t len = b.bits;
+
+  if (len > max_size() - bits) {
+    throw std::out_of_range("Unable to append: BitArray is too large");
+  }
+
+  resize(bits + len);
+
+  // Bytes of 'b' are taken after resize, which may move them
+  span(pos, len).assign(ConstBitSpan(b.data(), 0, len));
+
+  return *this;
 }
 
-BitArray &BitArray::set(int n, bool val) {
-  if (n < 0) {
-    throw std::invalid_argument("Unable to set: n is negative");
+BitArray &BitArray::append_bits(uint64_t word, int n) {
+  if (n < 0 || n > byte_bits) {
+    throw std::invalid_argument("Unable to append bits: n is out of range");
+  }
+
+  if (n == 0) {
+    return *this;
+  }
+
+  if (bits > max_size() - n) {
+    throw std::out_of_range("Unable to append: BitArray is too large");
+  }
+
+  if (n < byte_bits) {
+    word &= (1UL << n) - 1;
+  }
+
+  const size_t pos = bits;
+  const int bit_pos = pos % byte_bits;
+
+  invalidate();
+
+  // Unused bits of the last byte are 0, so bits are just or-ed there
+  bytes.resize(to_bytes(pos + n));
+  bits = pos + n;
+
+  bytes[pos / byte_bits] |= word << bit_pos;
+
+  if (bit_pos + n > byte_bits) {
+    bytes[pos / byte_bits + 1] = word >> (byte_bits - bit_pos);
   }
 
-  if ((unsigned int)n >= bits) {
+  return *this;
+}
+
+BitArray &BitArray::set(size_t n, bool val) {
+  if (n >= bits) {
     throw std::out_of_range("Unable to set: n is out of range");
   }
 
-  const int byte_pos = n / byte_bits;
+  const size_t byte_pos = n / byte_bits;
   const int bit_pos = n % byte_bits;
 
   const byte_type byte = bytes.at(byte_pos);
   const byte_type mask = 1UL << bit_pos;
 
+  invalidate();
+
   bytes[byte_pos] = val ? byte | mask : byte & ~mask;
 
   return *this;
 }
 
-bool BitArray::get(int i) const {
-  if (i < 0) {
-    throw std::invalid_argument("Unable to get: n is negative");
-  }
-
-  if ((unsigned int)i >= bits) {
-    throw std::out_of_range("Unable to set: n is out of range");
+bool BitArray::get(size_t i) const {
+  if (i >= bits) {
+    throw std::out_of_range("Unable to get: i is out of range");
   }
 
-  const int byte_pos = i / byte_bits;
+  const size_t byte_pos = i / byte_bits;
   const int bit_pos = i % byte_bits;
   return (bytes.at(byte_pos) >> bit_pos) & 1UL;
 }
 
 BitArray &BitArray::set() {
-  const int size = bytes.size();
-  const int trail = bits % byte_bits;
-
-  if (size > 0) {
-    bytes.assign(size, std::numeric_limits<byte_type>::max());
-  }
-  if (trail > 0) {
-    bytes[size - 1] = (1UL << trail) - 1;
-  }
+  invalidate();
+  BitKernels::fill(bytes.data(), bytes.size(),
+                   std::numeric_limits<byte_type>::max());
+  trim();
 
   return *this;
 }
 
-BitArray &BitArray::reset(int n) {
+BitArray &BitArray::reset(size_t n) {
   set(n, false);
   return *this;
 }
 
 BitArray &BitArray::reset() {
-  bytes.assign(bytes.size(), 0);
+  invalidate();
+  BitKernels::fill(bytes.data(), bytes.size(), 0);
+  return *this;
+}
+
+BitArray &BitArray::set_range(size_t pos, size_t len, bool val) {
+  check_range(pos, len, "Unable to set range: range is out of array");
+
+  if (val) {
+    span(pos, len).set();
+  } else {
+    span(pos, len).reset();
+  }
+
   return *this;
 }
 
+BitArray &BitArray::reset_range(size_t pos, size_t len) {
+  return set_range(pos, len, false);
+}
+
+BitArray &BitArray::flip_range(size_t pos, size_t len) {
+  check_range(pos, len, "Unable to flip range: range is out of array");
+
+  span(pos, len).flip();
+
+  return *this;
+}
+
+size_t BitArray::count_range(size_t pos, size_t len) const {
+  check_range(pos, len, "Unable to count range: range is out of array");
+
+  return span(pos, len).count();
+}
+
 bool BitArray::any() const {
-  const int size = bytes.size();
+  return BitKernels::any(bytes.data(), bytes.size());
+}
+
+bool BitArray::none() const { return !any(); }
+
+size_t BitArray::count() const {
+  return BitKernels::count(bytes.data(), bytes.size());
+}
+
+size_t BitArray::size() const { return bits; }
 
-  if (size <= 0) {
-    return false;
+bool BitArray::empty() const { return bits == 0; }
+
+size_t BitArray::rank1(size_t i) const {
+  if (i > bits) {
+    throw std::out_of_range("Unable to rank: i is out of range");
   }
 
-  for (const byte_type byte : bytes) {
-    if (byte > 0) {
-      return true;
-    }
+  const RankIndex &index = rank_directory();
+
+  const size_t byte_pos = i / byte_bits;
+  const int bit_pos = i % byte_bits;
+  const size_t block = byte_pos / RankIndex::block_bytes;
+  const size_t block_begin = block * RankIndex::block_bytes;
+
+  size_t rank = index.superblocks[block / RankIndex::superblock_blocks] +
+             index.blocks[block];
+
+  rank += BitKernels::count(bytes.data() + block_begin, byte_pos - block_begin);
+
+  if (bit_pos > 0) {
+    rank += __builtin_popcountl(bytes[byte_pos] & ((1UL << bit_pos) - 1));
   }
 
-  return false;
+  return rank;
 }
 
-bool BitArray::none() const { return !any(); }
+size_t BitArray::rank0(size_t i) const { return i - rank1(i); }
+
+size_t BitArray::select1(size_t k) const {
+  const RankIndex &index = rank_directory();
+
+  if (k >= index.ones) {
+    throw std::out_of_range("Unable to select: k is out of range");
+  }
+
+  // Last superblock with less than k ones before it, between the samples
+  const size_t sample = k / RankIndex::select_sample;
+  const size_t sb_end = sample + 1 < index.one_samples.size()
+                            ? index.one_samples[sample + 1] + 1
+                            : index.superblocks.size();
+  const auto sb_it = std::upper_bound(
+      index.superblocks.begin() + index.one_samples[sample],
+      index.superblocks.begin() + sb_end, (uint64_t)k);
+  const size_t superblock = sb_it - index.superblocks.begin() - 1;
+  k -= index.superblocks[superblock];
+
+  const size_t blocks = index.blocks.size();
+  size_t block = superblock * RankIndex::superblock_blocks;
+  const size_t block_end =
+      std::min(block + RankIndex::superblock_blocks, blocks);
+
+  while (block + 1 < block_end && index.blocks[block + 1] <= k) {
+    block++;
+  }
+  k -= index.blocks[block];
+
+  size_t byte_pos = block * RankIndex::block_bytes;
+
+  for (size_t c = __builtin_popcountl(bytes[byte_pos]); k >= c;
+       c = __builtin_popcountl(bytes[byte_pos])) {
+    k -= c;
+    byte_pos++;
+  }
+
+  return byte_pos * byte_bits + select_in_byte(bytes[byte_pos], k);
+}
+
+size_t BitArray::select0(size_t k) const {
+  const RankIndex &index = rank_directory();
+
+  if (k >= bits - index.ones) {
+    throw std::out_of_range("Unable to select: k is out of range");
+  }
 
-int BitArray::count() const {
-  int count = 0;
+  const size_t superblock_bits =
+      RankIndex::superblock_blocks * RankIndex::block_bytes * byte_bits;
+  const size_t block_bits = RankIndex::block_bytes * byte_bits;
 
-  for (const byte_type byte : bytes) {
-    byte_type cur = byte;
+  // Binary search of the last superblock with less than k zeros before it,
+  // between the samples
+  const size_t sample = k / RankIndex::select_sample;
+  size_t lo = index.zero_samples[sample];
+  size_t hi = sample + 1 < index.zero_samples.size()
+                  ? index.zero_samples[sample + 1] + 1
+                  : index.superblocks.size();
 
-    while (cur > 0) {
-      count += cur & 1UL;
-      cur >>= 1;
+  while (hi - lo > 1) {
+    const size_t mid = (lo + hi) / 2;
+    const size_t zeros = mid * superblock_bits - index.superblocks[mid];
+
+    if (zeros <= k) {
+      lo = mid;
+    } else {
+      hi = mid;
     }
   }
 
-  return count;
+  const size_t superblock = lo;
+  k -= superblock * superblock_bits - index.superblocks[superblock];
+
+  const size_t blocks = index.blocks.size();
+  size_t block = superblock * RankIndex::superblock_blocks;
+  const size_t first_block = block;
+  const size_t block_end =
+      std::min(block + RankIndex::superblock_blocks, blocks);
+
+  // Zeros from the start of the superblock to the start of the block
+  const auto zeros = [&](size_t block) {
+    return (block - first_block) * block_bits - index.blocks[block];
+  };
+
+  while (block + 1 < block_end && zeros(block + 1) <= k) {
+    block++;
+  }
+  k -= zeros(block);
+
+  size_t byte_pos = block * RankIndex::block_bytes;
+
+  for (size_t c = __builtin_popcountl(~bytes[byte_pos]); k >= c;
+       c = __builtin_popcountl(~bytes[byte_pos])) {
+    k -= c;
+    byte_pos++;
+  }
+
+  return byte_pos * byte_bits + select_in_byte(~bytes[byte_pos], k);
 }
 
-int BitArray::size() const { return bits; }
+size_t BitArray::rank_directory_bytes() const {
+  if (!rank_index.valid) {
+    return 0;
+  }
 
-bool BitArray::empty() const { return bits == 0; }
+  return (rank_index.superblocks.size() + rank_index.one_samples.size() +
+          rank_index.zero_samples.size()) *
+             sizeof(uint64_t) +
+         rank_index.blocks.size() * sizeof(uint16_t);
+}
 
-std::string BitArray::to_string() const {
-  std::string str(bits, '0');
-  int pos = bits - 1;
+size_t BitArray::find_first() const { return find_from(0, 0); }
 
-  for (const bool bit : *this) {
-    str[pos--] = bit ? '1' : '0';
+size_t BitArray::find_last() const { return find_to(bits - 1, 0); }
+
+size_t BitArray::find_next(size_t i) const {
+  if (i >= bits) {
+    throw std::out_of_range("Unable to find next: i is out of range");
+  }
+
+  return find_from(i + 1, 0);
+}
+
+size_t BitArray::find_first_zero() const { return find_from(0, ~0UL); }
+
+size_t BitArray::find_last_zero() const { return find_to(bits - 1, ~0UL); }
+
+size_t BitArray::find_next_zero(size_t i) const {
+  if (i >= bits) {
+    throw std::out_of_range("Unable to find next zero: i is out of range");
   }
 
-  return str;
+  return find_from(i + 1, ~0UL);
+}
+
+ConstBitSpan BitArray::span(size_t pos, size_t len) const {
+  return ConstBitSpan(*this).subspan(pos, len);
+}
+
+BitSpan BitArray::span(size_t pos, size_t len) {
+  return BitSpan(bytes.data(), 0, bits, &rank_index.valid).subspan(pos, len);
 }
 
-bool BitArray::operator[](int i) const {
-  if (i < 0 || i >= bits) {
+size_t BitArray::first_mismatch(const BitArray &b) const {
+  const size_t common = std::min(bits, b.bits);
+  const size_t full = common / byte_bits;
+  const int trail = common % byte_bits;
+
+  const size_t byte_pos =
+      BitKernels::mismatch(bytes.data(), b.bytes.data(), full);
+
+  byte_type diff = 0;
+
+  if (byte_pos < full) {
+    diff = bytes[byte_pos] ^ b.bytes[byte_pos];
+  } else if (trail > 0) {
+    diff = (bytes[full] ^ b.bytes[full]) & ((1UL << trail) - 1);
+  }
+
+  if (diff) {
+    return byte_pos * byte_bits + __builtin_ctzl(diff);
+  }
+
+  return bits == b.bits ? npos : common;
+}
+
+int BitArray::compare(const BitArray &b) const {
+  const size_t pos = first_mismatch(b);
+
+  if (pos == npos) {
+    return 0;
+  }
+
+  if (pos == std::min(bits, b.bits)) {
+    return bits < b.bits ? -1 : 1;
+  }
+
+  return get(pos) ? 1 : -1;
+}
+
+bool BitArray::operator[](size_t i) const {
+  if (i >= bits) {
     throw std::out_of_range("Out of range trying to access [i]th bit");
   }
 
   return get(i);
 }
 
-BitArray::BitProxy BitArray::operator[](int i) {
-  if (i < 0 || i >= bits) {
+BitArray::BitProxy BitArray::operator[](size_t i) {
+  if (i >= bits) {
     throw std::out_of_range("Out of range trying to access [i]th bit");
   }
-  return BitProxy(*this, i);
+
+  return BitProxy(bytes.data() + i / byte_bits, 1UL << (i % byte_bits),
+                  &rank_index.valid);
 }
 
 BitArray &BitArray::operator=(const BitArray &b) {
   if (this != &b) {
+    invalidate();
     bytes = b.bytes;
     bits = b.bits;
   }
   return *this;
 }
 
+BitArray &BitArray::operator=(BitArray &&b) {
+  if (this != &b) {
+    invalidate();
+    b.invalidate();
+    bytes = std::move(b.bytes);
+    bits = b.bits;
+    b.bits = 0;
+  }
+  return *this;
+}
+
 BitArray &BitArray::operator&=(const BitArray &b) {
   if (this == &b) {
     return *this;
@@ -215,11 +655,9 @@ BitArray &BitArray::operator&=(const BitArray &b) {
         "BitArrays must have the same size for &= operator");
   }
 
-  const int size = bytes.size();
+  invalidate();
 
-  for (int i = 0; i < size; i++) {
-    bytes[i] &= b.bytes[i];
-  }
+  BitKernels::bit_and(bytes.data(), b.bytes.data(), bytes.size());
 
   return *this;
 }
@@ -234,11 +672,9 @@ BitArray &BitArray::operator|=(const BitArray &b) {
         "BitArrays must have the same size for |= operator");
   }
 
-  const int size = bytes.size();
+  invalidate();
 
-  for (int i = 0; i < size; i++) {
-    bytes[i] |= b.bytes[i];
-  }
+  BitKernels::bit_or(bytes.data(), b.bytes.data(), bytes.size());
 
   return *this;
 }
@@ -249,36 +685,30 @@ BitArray &BitArray::operator^=(const BitArray &b) {
         "BitArrays must have the same size for ^= operator");
   }
 
-  const int size = bytes.size();
+  invalidate();
 
-  for (int i = 0; i < size; i++) {
-    bytes[i] ^= b.bytes[i];
-  }
+  BitKernels::bit_xor(bytes.data(), b.bytes.data(), bytes.size());
 
   return *this;
 }
 
-BitArray &BitArray::operator<<=(int n) {
-  if (n < 0) {
-    throw std::invalid_argument("Unable to <<= for negative n");
-  }
-
+BitArray &BitArray::operator<<=(size_t n) {
   if (n == 0) {
     return *this;
   }
 
-  if (n > std::numeric_limits<int>::max() - bits) {
-    throw std::out_of_range("BitArray bitwise >>= n is too large");
+  if (n > max_size() - bits) {
+    throw std::out_of_range("BitArray bitwise <<= n is too large");
   }
 
   resize(bits + n);
 
   const int bit_shift = n % byte_bits;
-  const int byte_shift = n / byte_bits;
-  const int size = bytes.size();
+  const size_t byte_shift = n / byte_bits;
+  const size_t size = bytes.size();
 
   if (byte_shift > 0) {
-    for (int i = size - 1; i >= 0; i--) {
+    for (size_t i = size; i-- > 0;) {
       bytes[i] = i >= byte_shift ? bytes[i - byte_shift] : 0UL;
     }
   }
@@ -286,7 +716,7 @@ BitArray &BitArray::operator<<=(int n) {
   if (bit_shift > 0) {
     const int inv_shift = byte_bits - bit_shift;
 
-    for (int i = size - 1; i > byte_shift; i--) {
+    for (size_t i = size - 1; i > byte_shift; i--) {
       bytes[i] = (bytes[i] << bit_shift) | (bytes[i - 1] >> inv_shift);
     }
 
@@ -296,11 +726,7 @@ BitArray &BitArray::operator<<=(int n) {
   return *this;
 }
 
-BitArray &BitArray::operator>>=(int n) {
-  if (n < 0) {
-    throw std::invalid_argument("Unable to >>= for negative n");
-  }
-
+BitArray &BitArray::operator>>=(size_t n) {
   if (n == 0) {
     return *this;
   }
@@ -312,11 +738,11 @@ BitArray &BitArray::operator>>=(int n) {
   }
 
   const int bit_shift = n % byte_bits;
-  const int byte_shift = n / byte_bits;
-  const int new_size = bytes.size() - byte_shift;
+  const size_t byte_shift = n / byte_bits;
+  const size_t new_size = bytes.size() - byte_shift;
 
   if (byte_shift > 0) {
-    for (int i = 0; i < new_size; i++) {
+    for (size_t i = 0; i < new_size; i++) {
       bytes[i] = bytes[i + byte_shift];
     }
   }
@@ -324,7 +750,7 @@ BitArray &BitArray::operator>>=(int n) {
   if (bit_shift > 0) {
     const int inv_shift = byte_bits - bit_shift;
 
-    for (int i = 0; i < new_size - 1; i++) {
+    for (size_t i = 0; i + 1 < new_size; i++) {
       bytes[i] = (bytes[i] >> bit_shift) | (bytes[i + 1] << inv_shift);
     }
 
@@ -336,132 +762,54 @@ BitArray &BitArray::operator>>=(int n) {
   return *this;
 }
 
-BitArray BitArray::operator<<(int n) const { return BitArray(*this) <<= n; }
-
-BitArray BitArray::operator>>(int n) const { return BitArray(*this) >>= n; }
-
 // Functions
 
 bool operator==(const BitArray &b1, const BitArray &b2) {
-  if (b1.size() != b2.size()) {
-    return false;
-  }
-
-  for (int i = 0; i < b1.size(); i++) {
-    if (b1[i] != b2[i]) {
-      return false;
-    }
-  }
-
-  return true;
+  return b1.size() == b2.size() && b1.first_mismatch(b2) == BitArray::npos;
 }
 
-bool operator!=(const BitArray &b1, const BitArray &b2) {
-  if (b1.size() != b2.size()) {
-    return true;
-  }
-
-  for (int i = 0; i < b1.size(); i++) {
-    if (b1[i] == b2[i]) {
-      return false;
-    }
-  }
+bool operator!=(const BitArray &b1, const BitArray &b2) { return !(b1 == b2); }
 
-  return true;
+bool operator<(const BitArray &b1, const BitArray &b2) {
+  return b1.compare(b2) < 0;
 }
 
-BitArray operator&(const BitArray &b1, const BitArray &b2) {
-  return BitArray(b1) &= b2;
+bool operator<=(const BitArray &b1, const BitArray &b2) {
+  return b1.compare(b2) <= 0;
 }
 
-BitArray operator|(const BitArray &b1, const BitArray &b2) {
-  return BitArray(b1) |= b2;
+bool operator>(const BitArray &b1, const BitArray &b2) {
+  return b1.compare(b2) > 0;
 }
 
-BitArray operator^(const BitArray &b1, const BitArray &b2) {
-  return BitArray(b1) ^= b2;
-}
-
-// Proxy
-
-BitArray::BitProxy::BitProxy(BitArray &ba, int idx) : ba(ba), idx(idx) {}
-
-BitArray::BitProxy &BitArray::BitProxy::operator=(bool bit) {
-  ba.set(idx, bit);
-  return *this;
+bool operator>=(const BitArray &b1, const BitArray &b2) {
+  return b1.compare(b2) >= 0;
 }
 
-BitArray::BitProxy::operator bool() const { return ba.get(idx); };
-
 // Iterators
 
-BitArray::ConstIterator::ConstIterator(const BitArray &ba, int idx)
-    : ba(ba), idx(idx) {
-  byte = idx >= ba.bits ? 0 : ba.bytes[idx / byte_bits];
-  byte >>= idx % byte_bits;
+BitSpan BitArray::Iterator::span(size_t len) const {
+  return BitSpan(byte, bit(), len, index_valid);
 }
 
-bool BitArray::ConstIterator::operator*() { return byte & 1UL; }
-
-BitArray::ConstIterator &BitArray::ConstIterator::operator++() {
-  ++idx;
-  byte >>= 1;
-
-  const int bit_pos = idx % byte_bits;
-  const int byte_pos = idx / byte_bits;
-
-  if (bit_pos == 0 && byte_pos < ba.bytes.size()) {
-    byte = ba.bytes[byte_pos];
-  }
-
-  return *this;
-}
-
-BitArray::ConstIterator BitArray::ConstIterator::operator++(int) {
-  ConstIterator temp = *this;
-  ++(*this);
-  return temp;
-}
-
-bool BitArray::ConstIterator::operator==(
-    const BitArray::ConstIterator &other) const {
-  return ba == other.ba && idx == other.idx;
-}
-
-bool BitArray::ConstIterator::operator!=(
-    const BitArray::ConstIterator &other) const {
-  return !(*this == other);
+ConstBitSpan BitArray::ConstIterator::span(size_t len) const {
+  return ConstBitSpan(byte, bit(), len);
 }
 
 BitArray::ConstIterator BitArray::begin() const {
-  return ConstIterator(*this, 0);
-};
-BitArray::ConstIterator BitArray::end() const {
-  return ConstIterator(*this, bits);
-};
-
-BitArray::Iterator::Iterator(BitArray &ba, int idx) : ba(ba), idx(idx) {};
-
-BitArray::BitProxy BitArray::Iterator::operator*() { return BitProxy(ba, idx); }
-
-BitArray::Iterator &BitArray::Iterator::operator++() {
-  idx++;
-  return *this;
+  return ConstIterator(bytes.data(), 1);
 }
 
-BitArray::Iterator BitArray::Iterator::operator++(int) {
-  Iterator temp = *this;
-  ++(*this);
-  return temp;
+BitArray::ConstIterator BitArray::end() const {
+  return ConstIterator(bytes.data() + bits / byte_bits,
+                       1UL << (bits % byte_bits));
 }
 
-bool BitArray::Iterator::operator==(const BitArray::Iterator &other) const {
-  return ba == other.ba && idx == other.idx;
+BitArray::Iterator BitArray::begin() {
+  return Iterator(bytes.data(), 1, &rank_index.valid);
 }
 
-bool BitArray::Iterator::operator!=(const BitArray::Iterator &other) const {
-  return !(*this == other);
+BitArray::Iterator BitArray::end() {
+  return Iterator(bytes.data() + bits / byte_bits, 1UL << (bits % byte_bits),
+                  &rank_index.valid);
 }
-
-BitArray::Iterator BitArray::begin() { return Iterator(*this, 0); };
-BitArray::Iterator BitArray::end() { return Iterator(*this, bits); };
@@ -1,72 +1,293 @@
 #ifndef BIT_ARRAY
 #define BIT_ARRAY
 
+#include "bit-expr.h"
+#include "bit-kernels.h"
+#include "bit-span.h"
+#include "byte-storage.h"
+#include <algorithm>
 #include <climits>
+#include <cstddef>
 #include <cstdint>
+#include <iosfwd>
+#include <iterator>
 #include <string>
 #include <vector>
 
-using byte_type = ulong;
 const int byte_size = sizeof(byte_type);
 
-class BitArray {
+class BitArray : public BitExpr<BitArray> {
 private:
-  std::vector<byte_type> bytes;
-  unsigned int bits;
+  // Rank/select directory, built by the first query after a mutation
+  // Superblocks keep ones before each superblock, blocks keep ones from the
+  // start of their superblock, which costs ~4.7% of the bit array size.
+  // Samples keep the superblock of every 'select_sample'th one and zero, so
+  // select searches only superblocks between two samples
+  struct RankIndex {
+    static constexpr size_t block_bytes = 8;
+    static constexpr size_t superblock_blocks = 8;
+    static constexpr size_t select_sample = 4096;
+
+    std::vector<uint64_t> superblocks;
+    std::vector<uint16_t> blocks;
+    std::vector<uint64_t> one_samples;
+    std::vector<uint64_t> zero_samples;
+    size_t ones = 0;
+    bool valid = false;
+  };
+
+  ByteStorage bytes;
+  size_t bits;
+  mutable RankIndex rank_index;
+
+  static size_t to_bytes(size_t bits);
+
+  // Drop rank/select directory after bits have been changed
+  void invalidate() { rank_index.valid = false; }
+
+  // Write expression into the array in one pass
+  // Expression must not read bytes of this array, which are already written
+  template <class E> void evaluate(const E &expr);
+
+  // Rebuild rank/select directory if needed
+  const RankIndex &rank_directory() const;
+
+  // First (last) bit in range [from, bits) ([0, to]), which differs from
+  // bits of 'flip', or npos
+  size_t find_from(size_t from, byte_type flip) const;
+  size_t find_to(size_t to, byte_type flip) const;
 
-  static int to_bytes(int bits);
+  // Throw std::out_of_range, if [pos, pos + len) is not inside of the array
+  void check_range(size_t pos, size_t len, const char *msg) const;
+
+  template <class Source> static BitArray read(Source &source);
+
+  // Zero unused bits of the last byte, so bulk operations can work on whole
+  // bytes
+  void trim();
 
 public:
   static const int byte_bits = sizeof(byte_type) * byte_size;
 
+  // Returned by queries, when there is no such position
+  static constexpr size_t npos = -1;
+
+  // Largest supported size, so distance between any two bits fits ptrdiff_t
+  static constexpr size_t max_size() { return PTRDIFF_MAX; }
+
+  // Binary encodings of serialize()
+  // raw: 64-bit little-endian magic and size in bits, then bytes as
+  //      little-endian words, same as the file of MappedBitArray
+  // wah: same header, then word-aligned hybrid code, where every marker
+  //      word tells length of a run of 0 or ~0 words and number of literal
+  //      words, which follow the marker
+  enum class Format { raw, wah };
+
+  // Text encodings of to_chars() and from_chars()
+  // binary: '0' and '1', the last bit first, same as to_string()
+  // hex:    digits of 4 bits, the last digit first, lower case on output
+  // base64: RFC 4648 code with padding of the array as little-endian bytes
+  enum class TextFormat { binary, hex, base64 };
+
   // Proxy
 
+  // Reference to a bit by its byte and mask, checks are done by operator[]
   class BitProxy {
   private:
-    unsigned int idx;
-    BitArray &ba;
+    byte_type *byte;
+    byte_type mask;
+    bool *index_valid;
+
+    friend class BitArray;
+    BitProxy(byte_type *byte, byte_type mask, bool *index_valid)
+        : byte(byte), mask(mask), index_valid(index_valid) {}
 
   public:
-    BitProxy(BitArray &ba, int idx);
-    BitProxy &operator=(bool bit);
-    operator bool() const;
+    // Proxy always refers to the same bit, so writes are const
+    const BitProxy &operator=(bool bit) const {
+      *index_valid = false;
+      *byte = bit ? *byte | mask : *byte & ~mask;
+      return *this;
+    }
+
+    // Copy value of the bit, not the reference
+    const BitProxy &operator=(const BitProxy &other) const {
+      return *this = bool(other);
+    }
+
+    operator bool() const { return *byte & mask; }
+
+    // Invert the bit
+    const BitProxy &flip() const { return *this = !*this; }
   };
 
   // Iterators
 
-  class ConstIterator {
+  class Iterator;
+
+  // Random access over bits, position is a byte pointer and a bit mask
+  // Operators are common for both iterators, It is the iterator type
+  template <class It, class Byte> class IteratorBase {
+  protected:
+    Byte *byte;
+    byte_type mask;
+
+    IteratorBase(Byte *byte, byte_type mask) : byte(byte), mask(mask) {}
+
+    It &self() { return static_cast<It &>(*this); }
+
+    // Position of the bit in its byte
+    int bit() const { return __builtin_ctzl(mask); }
+
+  public:
+    using value_type = bool;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using iterator_category = std::random_access_iterator_tag;
+    using iterator_concept = std::random_access_iterator_tag;
+
+    It &operator++() {
+      mask <<= 1;
+      if (!mask) {
+        byte++;
+        mask = 1;
+      }
+      return self();
+    }
+
+    It &operator--() {
+      if (mask == 1) {
+        byte--;
+        mask = 1UL << (byte_bits - 1);
+      } else {
+        mask >>= 1;
+      }
+      return self();
+    }
+
+    It operator++(int) {
+      It temp = self();
+      ++*this;
+      return temp;
+    }
+
+    It operator--(int) {
+      It temp = self();
+      --*this;
+      return temp;
+    }
+
+    It &operator+=(difference_type n) {
+      const difference_type pos = bit() + n;
+
+      // Division is rounded down, so bits before the byte go backwards
+      byte += pos >= 0 ? pos / byte_bits : -((byte_bits - 1 - pos) / byte_bits);
+      mask = 1UL << (pos & (byte_bits - 1));
+
+      return self();
+    }
+
+    It &operator-=(difference_type n) { return *this += -n; }
+
+    friend It operator+(It it, difference_type n) { return it += n; }
+    friend It operator+(difference_type n, It it) { return it += n; }
+    friend It operator-(It it, difference_type n) { return it -= n; }
+
+    friend difference_type operator-(const It &a, const It &b) {
+      return (a.byte - b.byte) * byte_bits + a.bit() - b.bit();
+    }
+
+    friend bool operator==(const It &a, const It &b) {
+      return a.byte == b.byte && a.mask == b.mask;
+    }
+
+    friend bool operator!=(const It &a, const It &b) { return !(a == b); }
+
+    friend bool operator<(const It &a, const It &b) {
+      return a.byte < b.byte || (a.byte == b.byte && a.mask < b.mask);
+    }
+
+    friend bool operator>(const It &a, const It &b) { return b < a; }
+    friend bool operator<=(const It &a, const It &b) { return !(b < a); }
+    friend bool operator>=(const It &a, const It &b) { return !(a < b); }
+
+    // Algorithms, which search, count and copy bits by whole bytes through
+    // bit views. They are found by argument-dependent lookup, so calls must
+    // be unqualified, like find(b.begin(), b.end(), 1), or follow
+    // 'using std::find;'. Value is compared with bits like with bool
+
+    template <class T> friend It find(It first, It last, const T &value) {
+      const bool ones = true == value;
+      const bool zeros = false == value;
+
+      if (ones == zeros) {
+        return ones ? first : last;
+      }
+
+      const ConstBitSpan span = first.span(last - first);
+      const size_t pos = ones ? span.find_first() : span.find_first_zero();
+      return pos == npos ? last : first + pos;
+    }
+
+    template <class T>
+    friend difference_type count(It first, It last, const T &value) {
+      const bool ones = true == value;
+      const bool zeros = false == value;
+      const difference_type size = last - first;
+      const difference_type set =
+          ones || zeros ? first.span(size).count() : 0;
+
+      return (ones ? set : 0) + (zeros ? size - set : 0);
+    }
+
+    friend Iterator copy(It first, It last, Iterator d_first) {
+      const size_t len = last - first;
+      d_first.span(len).assign(first.span(len));
+      return d_first + len;
+    }
+  };
+
+  class ConstIterator;
+
+  class Iterator : public IteratorBase<Iterator, byte_type> {
   private:
-    const BitArray &ba;
-    unsigned int idx;
-    byte_type byte;
+    // Validity flag of the rank/select directory of the array
+    bool *index_valid;
+
+    friend class BitArray;
+    friend class ConstIterator;
+    Iterator(byte_type *byte, byte_type mask, bool *index_valid)
+        : IteratorBase(byte, mask), index_valid(index_valid) {}
 
   public:
-    ConstIterator(const BitArray &ba, int idx);
+    using reference = BitProxy;
 
-    bool operator*();
+    Iterator() : IteratorBase(nullptr, 1), index_valid(nullptr) {}
 
-    ConstIterator &operator++();
-    ConstIterator operator++(int);
+    BitProxy operator*() const { return BitProxy(byte, mask, index_valid); }
+    BitProxy operator[](difference_type n) const { return *(*this + n); }
 
-    bool operator==(const ConstIterator &other) const;
-    bool operator!=(const ConstIterator &other) const;
+    // View of 'len' bits, which start at the iterator
+    BitSpan span(size_t len) const;
   };
 
-  class Iterator {
+  class ConstIterator : public IteratorBase<ConstIterator, const byte_type> {
   private:
-    BitArray &ba;
-    unsigned int idx;
+    friend class BitArray;
+    ConstIterator(const byte_type *byte, byte_type mask)
+        : IteratorBase(byte, mask) {}
 
   public:
-    Iterator(BitArray &ba, int idx);
+    using reference = bool;
 
-    BitProxy operator*();
+    ConstIterator() : IteratorBase(nullptr, 1) {}
+    ConstIterator(const Iterator &it) : IteratorBase(it.byte, it.mask) {}
 
-    Iterator &operator++();
-    Iterator operator++(int);
+    bool operator*() const { return *byte & mask; }
+    bool operator[](difference_type n) const { return *(*this + n); }
 
-    bool operator==(const Iterator &other) const;
-    bool operator!=(const Iterator &other) const;
+    // View of 'len' bits, which start at the iterator
+    ConstBitSpan span(size_t len) const;
   };
 
   BitArray();
@@ -74,25 +295,54 @@ public:
 
   // Construct array, with specified amount of bits
   // First sizeof(long) bits may be initialized with parameter 'value'
-  explicit BitArray(int num_bits, byte_type value = 0);
+  explicit BitArray(size_t num_bits, byte_type value = 0);
   BitArray(const BitArray &b);
 
+  // Same as above, bytes are allocated from 'resource', which must outlive
+  // the array
+  // Like in pmr containers, assignment keeps the resource of the target and
+  // plain copies use the default resource
+  BitArray(size_t num_bits, byte_type value,
+           std::pmr::memory_resource *resource);
+  BitArray(const BitArray &b, std::pmr::memory_resource *resource);
+
+  // Resource, which bytes are allocated from
+  std::pmr::memory_resource *resource() const { return bytes.resource(); }
+  BitArray(BitArray &&b) noexcept;
+
+  // Evaluate bitwise expression, like a & b | ~c
+  template <class E> BitArray(const BitExpr<E> &expr);
+
   // Replace values of 2 bit arrays
   void swap(BitArray &b);
 
   BitArray &operator=(const BitArray &b);
+  BitArray &operator=(BitArray &&b);
+  template <class E> BitArray &operator=(const BitExpr<E> &expr);
 
   // Resize bit array
   // If array expands, new elements are initialized with 'value'
-  void resize(int num_bits, bool value = false);
+  void resize(size_t num_bits, bool value = false);
 
   // Clear bit array
   void clear();
 
+  // Make room for 'num_bits' bits without reallocation
+  void reserve(size_t num_bits);
+
+  // Number of bits, which fit into allocated memory
+  size_t capacity() const;
+
   // Add 1 bit at the end of bit array
-  // Reallocate memory if needed
+  // Memory grows geometrically, so appends take amortized constant time
   void push_back(bool bit);
 
+  // Add bits of 'b' at the end, 'b' may be this array
+  BitArray &append(const BitArray &b);
+
+  // Add n lowest bits of 'word' at the end, 0 <= n <= 64
+  BitArray &append_bits(uint64_t word, int n);
+
   // Bit operators for bit array
   // Can be used only for array of the same size
   BitArray &operator&=(const BitArray &b);
@@ -100,58 +350,195 @@ public:
   BitArray &operator^=(const BitArray &b);
 
   // Bitwise shifting, filling with 0's
-  BitArray &operator<<=(int n);
-  BitArray &operator>>=(int n);
-  BitArray operator<<(int n) const;
-  BitArray operator>>(int n) const;
+  BitArray &operator<<=(size_t n);
+  BitArray &operator>>=(size_t n);
 
   // Set n'th bit to 'value'
-  BitArray &set(int n, bool val = true);
+  BitArray &set(size_t n, bool val = true);
 
   // Fill array with 1's
   BitArray &set();
 
   // Set n'th bit to 0
-  BitArray &reset(int n);
+  BitArray &reset(size_t n);
 
   // Fill array with 0's
   BitArray &reset();
 
+  // Set bits [pos, pos + len) to 'value' (0, invert them)
+  // Whole bytes inside of the range are filled at once
+  BitArray &set_range(size_t pos, size_t len, bool val = true);
+  BitArray &reset_range(size_t pos, size_t len);
+  BitArray &flip_range(size_t pos, size_t len);
+
+  // Count bits of value 1 in range [pos, pos + len)
+  size_t count_range(size_t pos, size_t len) const;
+
   // True, if at least one bit of value 1
   bool any() const;
 
   // True, if all bits are 0's
   bool none() const;
 
-  // Bit inversion
-  BitArray operator~() const;
-
   // Count bits of value 1
-  int count() const;
+  size_t count() const;
 
   // Return i'th bit value
-  bool get(int i) const;
-  bool operator[](int i) const;
-  BitProxy operator[](int i);
+  bool get(size_t i) const;
+  bool operator[](size_t i) const;
+  BitProxy operator[](size_t i);
 
-  int size() const;
+  size_t size() const;
   bool empty() const;
 
+  // Return i'th byte, 0 if it is out of range
+  byte_type byte(size_t i) const { return i < bytes.size() ? bytes[i] : 0; }
+
+  // View of bits [pos, pos + len), len is cut at the end of the array
+  // Changes through the view are seen by the array, view is invalidated by
+  // operations, which resize the array
+  ConstBitSpan span(size_t pos = 0, size_t len = npos) const;
+  BitSpan span(size_t pos = 0, size_t len = npos);
+
+  // Raw bytes, unused bits of the last byte are 0
+  const byte_type *data() const { return bytes.data(); }
+  size_t byte_count() const { return bytes.size(); }
+
+  // Count bits of value 1 (0) in range [0, i)
+  size_t rank1(size_t i) const;
+  size_t rank0(size_t i) const;
+
+  // Position of k'th (starting from 0) bit of value 1 (0)
+  size_t select1(size_t k) const;
+  size_t select0(size_t k) const;
+
+  // Memory of the rank/select directory, 0 until a query builds it
+  size_t rank_directory_bytes() const;
+
+  // Position of the first (last) bit of value 1, or npos
+  size_t find_first() const;
+  size_t find_last() const;
+
+  // Position of the first bit of value 1 after i'th bit, or npos
+  size_t find_next(size_t i) const;
+
+  // Position of the first (last) bit of value 0, or npos
+  size_t find_first_zero() const;
+  size_t find_last_zero() const;
+
+  // Position of the first bit of value 0 after i'th bit, or npos
+  size_t find_next_zero(size_t i) const;
+
+  // Call f(i) for every bit of value 1 in ascending order
+  template <class F> void for_each_set_bit(F f) const {
+    const size_t size = bytes.size();
+
+    for (size_t byte_pos = 0; byte_pos < size; byte_pos++) {
+      for (byte_type byte = bytes[byte_pos]; byte; byte &= byte - 1) {
+        f(byte_pos * byte_bits + __builtin_ctzl(byte));
+      }
+    }
+  }
+
+  // Index of the first bit, which differs in both arrays
+  // If one array is a prefix of the other, return size of the shorter one
+  // If arrays are equal, return npos
+  size_t first_mismatch(const BitArray &b) const;
+
+  // Lexicographic comparison starting from bit 0
+  // Return negative, zero or positive value, like std::string::compare
+  int compare(const BitArray &b) const;
+
   // Return string representation of bit array
-  std::string to_string() const;
+  std::string to_string(TextFormat format = TextFormat::binary) const;
+
+  // Read array from text, see from_chars()
+  static BitArray from_string(const std::string &text,
+                              TextFormat format = TextFormat::binary);
+
+  // Length of text of 'num_bits' bits
+  static size_t text_size(size_t num_bits, TextFormat format);
+
+  // Write text of the array into buffer of 'size' chars without a trailing
+  // zero, return pointer past the last written char
+  // Throws std::invalid_argument, if text is longer than the buffer
+  char *to_chars(char *out, size_t size, TextFormat format) const;
+
+  // Replace bits with bits of text: 'size' bits of binary text, 4 * 'size'
+  // bits of hex text, 8 bits per decoded byte of base64
+  // Memory is reused, if array is large enough
+  // Throws std::invalid_argument, if text is malformed, then the array is
+  // unchanged
+  BitArray &from_chars(const char *text, size_t size, TextFormat format);
+
+  // Write binary representation into stream or file descriptor
+  // Throws std::runtime_error (std::system_error for descriptors), if
+  // writing fails
+  void serialize(std::ostream &out, Format format = Format::raw) const;
+  void serialize(int fd, Format format = Format::raw) const;
+
+  // Read array written by serialize(), format is taken from the header
+  // Throws std::runtime_error, if input is truncated or corrupted
+  static BitArray deserialize(std::istream &in);
+  static BitArray deserialize(int fd);
 
   ConstIterator begin() const;
   ConstIterator end() const;
 
   Iterator begin();
   Iterator end();
+
+  // Range versions of find() and count() of iterators
+  template <class T>
+  friend ConstIterator find(const BitArray &b, const T &value) {
+    return find(b.begin(), b.end(), value);
+  }
+
+  template <class T> friend size_t count(const BitArray &b, const T &value) {
+    const size_t ones = b.count();
+    return (true == value ? ones : 0) + (false == value ? b.size() - ones : 0);
+  }
 };
 
 bool operator==(const BitArray &b1, const BitArray &b2);
 bool operator!=(const BitArray &b1, const BitArray &b2);
-
-BitArray operator&(const BitArray &b1, const BitArray &b2);
-BitArray operator|(const BitArray &b1, const BitArray &b2);
-BitArray operator^(const BitArray &b1, const BitArray &b2);
+bool operator<(const BitArray &b1, const BitArray &b2);
+bool operator<=(const BitArray &b1, const BitArray &b2);
+bool operator>(const BitArray &b1, const BitArray &b2);
+bool operator>=(const BitArray &b1, const BitArray &b2);
+
+// Expressions
+
+template <class E> BitArray::BitArray(const BitExpr<E> &expr) : bits(0) {
+  evaluate(expr.self());
+}
+
+template <class E> BitArray &BitArray::operator=(const BitExpr<E> &expr) {
+  // Shifts may read bytes of this array, which are already overwritten
+  if (!BitExprTraits<E>::elementwise) {
+    return *this = BitArray(expr);
+  }
+
+  evaluate(expr.self());
+  return *this;
+}
+
+template <class E> void BitArray::evaluate(const E &expr) {
+  const size_t num_bits = expr.size();
+  const size_t size = to_bytes(num_bits);
+
+  invalidate();
+  bytes.resize(size);
+  bits = num_bits;
+
+  byte_type *data = bytes.data();
+
+  // Bytes of expression are independent, so large arrays are split
+  BitKernels::for_each_part(size, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      data[i] = expr.byte(i);
+    }
+  });
+}
 
 #endif
@@ -0,0 +1,211 @@
+#ifndef BIT_EXPR
+#define BIT_EXPR
+
+#include "bit-kernels.h"
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Lazy bitwise expressions over bit arrays
+// Nothing is computed until expression is assigned to a BitArray, then all
+// operations are fused into one pass over the bytes of the destination
+
+class BitArray;
+
+// Base of all expressions
+// Every expression has size() in bits and byte(i), which is 0 for bytes
+// outside of the expression, unused bits of the last byte are 0 as well
+template <class E> class BitExpr {
+public:
+  const E &self() const { return static_cast<const E &>(*this); }
+};
+
+// Bit arrays are kept by reference, nested expressions by value, so
+// expressions don't outlive temporaries they are built from
+template <class E> struct BitExprTraits {
+  using store = const E;
+  static constexpr bool elementwise = E::elementwise;
+};
+
+template <> struct BitExprTraits<BitArray> {
+  using store = const BitArray &;
+  static constexpr bool elementwise = true;
+};
+
+struct BitAndOp {
+  static byte_type apply(byte_type a, byte_type b) { return a & b; }
+};
+
+struct BitOrOp {
+  static byte_type apply(byte_type a, byte_type b) { return a | b; }
+};
+
+struct BitXorOp {
+  static byte_type apply(byte_type a, byte_type b) { return a ^ b; }
+};
+
+template <class L, class R, class Op>
+class BitBinaryExpr : public BitExpr<BitBinaryExpr<L, R, Op>> {
+private:
+  typename BitExprTraits<L>::store l;
+  typename BitExprTraits<R>::store r;
+
+public:
+  static constexpr bool elementwise =
+      BitExprTraits<L>::elementwise && BitExprTraits<R>::elementwise;
+
+  BitBinaryExpr(const L &l, const R &r) : l(l), r(r) {
+    if (l.size() != r.size()) {
+      throw std::invalid_argument(
+          "BitArrays must have the same size for bitwise operator");
+    }
+  }
+
+  size_t size() const { return l.size(); }
+  byte_type byte(size_t i) const { return Op::apply(l.byte(i), r.byte(i)); }
+};
+
+template <class E> class BitNotExpr : public BitExpr<BitNotExpr<E>> {
+private:
+  static constexpr int byte_bits = sizeof(byte_type) * CHAR_BIT;
+
+  typename BitExprTraits<E>::store e;
+  size_t bytes;
+  byte_type last_mask;
+
+public:
+  static constexpr bool elementwise = BitExprTraits<E>::elementwise;
+
+  explicit BitNotExpr(const E &e)
+      : e(e), bytes((e.size() + byte_bits - 1) / byte_bits),
+        last_mask(e.size() % byte_bits ? (1UL << e.size() % byte_bits) - 1
+                                       : ~0UL) {}
+
+  size_t size() const { return e.size(); }
+
+  byte_type byte(size_t i) const {
+    if (i >= bytes) {
+      return 0;
+    }
+
+    return i == bytes - 1 ? ~e.byte(i) & last_mask : ~e.byte(i);
+  }
+};
+
+// Shift to the higher bits, array grows by n bits
+template <class E>
+class BitLeftShiftExpr : public BitExpr<BitLeftShiftExpr<E>> {
+private:
+  static constexpr int byte_bits = sizeof(byte_type) * CHAR_BIT;
+
+  typename BitExprTraits<E>::store e;
+  size_t bits;
+  size_t byte_shift;
+  int bit_shift;
+
+public:
+  // Bytes are read from lower positions, so result can't be written over
+  // the source
+  static constexpr bool elementwise = false;
+
+  BitLeftShiftExpr(const E &e, size_t n)
+      : e(e), bits(shifted_size(e.size(), n)), byte_shift(n / byte_bits),
+        bit_shift(n % byte_bits) {}
+
+  // Size limit is the same as BitArray::max_size()
+  static size_t shifted_size(size_t size, size_t n) {
+    if (n > PTRDIFF_MAX - size) {
+      throw std::out_of_range("BitArray bitwise << n is too large");
+    }
+
+    return size + n;
+  }
+
+  size_t size() const { return bits; }
+
+  byte_type byte(size_t i) const {
+    if (i < byte_shift) {
+      return 0;
+    }
+
+    const size_t j = i - byte_shift;
+
+    if (bit_shift == 0) {
+      return e.byte(j);
+    }
+
+    const byte_type high = e.byte(j) << bit_shift;
+    return j > 0 ? high | e.byte(j - 1) >> (byte_bits - bit_shift) : high;
+  }
+};
+
+// Shift to the lower bits, array shrinks by n bits
+template <class E>
+class BitRightShiftExpr : public BitExpr<BitRightShiftExpr<E>> {
+private:
+  static constexpr int byte_bits = sizeof(byte_type) * CHAR_BIT;
+
+  typename BitExprTraits<E>::store e;
+  size_t bits;
+  size_t byte_shift;
+  int bit_shift;
+
+public:
+  static constexpr bool elementwise = false;
+
+  BitRightShiftExpr(const E &e, size_t n)
+      : e(e), bits(n >= e.size() ? 0 : e.size() - n),
+        byte_shift(n / byte_bits), bit_shift(n % byte_bits) {}
+
+  size_t size() const { return bits; }
+
+  byte_type byte(size_t i) const {
+    if (i >= (bits + byte_bits - 1) / byte_bits) {
+      return 0;
+    }
+
+    const size_t j = i + byte_shift;
+
+    if (bit_shift == 0) {
+      return e.byte(j);
+    }
+
+    return (e.byte(j) >> bit_shift) |
+           (e.byte(j + 1) << (byte_bits - bit_shift));
+  }
+};
+
+template <class L, class R>
+BitBinaryExpr<L, R, BitAndOp> operator&(const BitExpr<L> &l,
+                                        const BitExpr<R> &r) {
+  return BitBinaryExpr<L, R, BitAndOp>(l.self(), r.self());
+}
+
+template <class L, class R>
+BitBinaryExpr<L, R, BitOrOp> operator|(const BitExpr<L> &l,
+                                       const BitExpr<R> &r) {
+  return BitBinaryExpr<L, R, BitOrOp>(l.self(), r.self());
+}
+
+template <class L, class R>
+BitBinaryExpr<L, R, BitXorOp> operator^(const BitExpr<L> &l,
+                                        const BitExpr<R> &r) {
+  return BitBinaryExpr<L, R, BitXorOp>(l.self(), r.self());
+}
+
+template <class E> BitNotExpr<E> operator~(const BitExpr<E> &e) {
+  return BitNotExpr<E>(e.self());
+}
+
+template <class E>
+BitLeftShiftExpr<E> operator<<(const BitExpr<E> &e, size_t n) {
+  return BitLeftShiftExpr<E>(e.self(), n);
+}
+
+template <class E>
+BitRightShiftExpr<E> operator>>(const BitExpr<E> &e, size_t n) {
+  return BitRightShiftExpr<E>(e.self(), n);
+}
+
+#endif
@@ -0,0 +1,804 @@
+#include "bit-kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BIT_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// Generic
+
+static size_t count_generic(const byte_type *bytes, size_t size) {
+  size_t count = 0;
+
+  for (size_t i = 0; i < size; i++) {
+    count += __builtin_popcountl(bytes[i]);
+  }
+
+  return count;
+}
+
+static bool any_generic(const byte_type *bytes, size_t size) {
+  size_t i = 0;
+
+  for (; i + 4 <= size; i += 4) {
+    if (bytes[i] | bytes[i + 1] | bytes[i + 2] | bytes[i + 3]) {
+      return true;
+    }
+  }
+
+  for (; i < size; i++) {
+    if (bytes[i]) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void and_generic(byte_type *dst, const byte_type *src, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] &= src[i];
+  }
+}
+
+static void or_generic(byte_type *dst, const byte_type *src, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] |= src[i];
+  }
+}
+
+static void xor_generic(byte_type *dst, const byte_type *src, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] ^= src[i];
+  }
+}
+
+static void not_generic(byte_type *dst, const byte_type *src, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] = ~src[i];
+  }
+}
+
+static size_t mismatch_generic(const byte_type *a, const byte_type *b,
+                               size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (a[i] != b[i]) {
+      return i;
+    }
+  }
+
+  return size;
+}
+
+static void fill_generic(byte_type *bytes, size_t size, byte_type value) {
+  if (value == 0) {
+    std::memset(bytes, 0, size * sizeof(byte_type));
+    return;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    bytes[i] = value;
+  }
+}
+
+static void unpack_generic(const byte_type *bytes, size_t pos, int width,
+                           uint32_t *out, size_t size) {
+  const byte_type mask = (1UL << width) - 1;
+
+  for (size_t j = 0; j < size; j++, pos += width) {
+    const size_t i = pos / 64;
+    const int offset = pos % 64;
+
+    // Second shift is split, so offset 0 takes nothing from the next word
+    const byte_type low = bytes[i] >> offset;
+    const byte_type high = (bytes[i + 1] << 1) << (63 - offset);
+
+    out[j] = (low | high) & mask;
+  }
+}
+
+static void pack_generic(byte_type *bytes, size_t pos, int width,
+                         const uint32_t *in, size_t size) {
+  if (size == 0) {
+    return;
+  }
+
+  // Fields are collected in a word, which is written when it is full
+  size_t i = pos / 64;
+  int fill = pos % 64;
+  byte_type word = bytes[i] & ((1UL << fill) - 1);
+
+  for (size_t j = 0; j < size; j++) {
+    word |= byte_type(in[j]) << fill;
+    fill += width;
+
+    if (fill >= 64) {
+      bytes[i++] = word;
+      fill -= 64;
+      word = fill ? byte_type(in[j]) >> (width - fill) : 0;
+    }
+  }
+
+  if (fill > 0) {
+    bytes[i] = word | (bytes[i] & (~0UL << fill));
+  }
+}
+
+static void hamming_generic(const byte_type *blocks, size_t words,
+                            const byte_type *query, uint32_t *out,
+                            size_t size) {
+  constexpr size_t lanes = BitKernels::hamming_lanes;
+
+  for (size_t b = 0; b < size; b++, blocks += words * lanes) {
+    uint32_t acc[lanes] = {};
+
+    for (size_t j = 0; j < words; j++) {
+      for (size_t v = 0; v < lanes; v++) {
+        acc[v] += __builtin_popcountl(blocks[j * lanes + v] ^ query[j]);
+      }
+    }
+
+    std::copy(acc, acc + lanes, out + b * lanes);
+  }
+}
+
+#ifdef BIT_KERNELS_X86
+
+// Hardware popcount
+
+__attribute__((target("popcnt"))) static size_t
+count_popcnt(const byte_type *bytes, size_t size) {
+  size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+  size_t i = 0;
+
+  // Independent accumulators hide popcnt latency
+  for (; i + 4 <= size; i += 4) {
+    c0 += __builtin_popcountl(bytes[i]);
+    c1 += __builtin_popcountl(bytes[i + 1]);
+    c2 += __builtin_popcountl(bytes[i + 2]);
+    c3 += __builtin_popcountl(bytes[i + 3]);
+  }
+
+  for (; i < size; i++) {
+    c0 += __builtin_popcountl(bytes[i]);
+  }
+
+  return c0 + c1 + c2 + c3;
+}
+
+__attribute__((target("popcnt"))) static void
+hamming_popcnt(const byte_type *blocks, size_t words, const byte_type *query,
+               uint32_t *out, size_t size) {
+  constexpr size_t lanes = BitKernels::hamming_lanes;
+
+  for (size_t b = 0; b < size; b++, blocks += words * lanes) {
+    uint32_t acc[lanes] = {};
+
+    for (size_t j = 0; j < words; j++) {
+      for (size_t v = 0; v < lanes; v++) {
+        acc[v] += __builtin_popcountl(blocks[j * lanes + v] ^ query[j]);
+      }
+    }
+
+    std::copy(acc, acc + lanes, out + b * lanes);
+  }
+}
+
+// AVX2
+
+static constexpr size_t avx2_words = sizeof(__m256i) / sizeof(byte_type);
+
+// Bit counts of every byte of 'v', summed into 4 64-bit lanes
+__attribute__((target("avx2"))) static inline __m256i
+popcount_avx2(__m256i v) {
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+  const __m256i lo = _mm256_and_si256(v, low_mask);
+  const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                      _mm256_shuffle_epi8(lookup, hi));
+
+  return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+count_avx2(const byte_type *bytes, size_t size) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 2 * avx2_words <= size; i += 2 * avx2_words) {
+    const __m256i v1 = _mm256_loadu_si256((const __m256i *)(bytes + i));
+    const __m256i v2 =
+        _mm256_loadu_si256((const __m256i *)(bytes + i + avx2_words));
+    acc = _mm256_add_epi64(acc, popcount_avx2(v1));
+    acc = _mm256_add_epi64(acc, popcount_avx2(v2));
+  }
+
+  size_t count = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+                 _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+
+  for (; i < size; i++) {
+    count += __builtin_popcountl(bytes[i]);
+  }
+
+  return count;
+}
+
+__attribute__((target("avx2"))) static bool any_avx2(const byte_type *bytes,
+                                                     size_t size) {
+  size_t i = 0;
+
+  for (; i + 2 * avx2_words <= size; i += 2 * avx2_words) {
+    const __m256i v1 = _mm256_loadu_si256((const __m256i *)(bytes + i));
+    const __m256i v2 =
+        _mm256_loadu_si256((const __m256i *)(bytes + i + avx2_words));
+    const __m256i v = _mm256_or_si256(v1, v2);
+
+    if (!_mm256_testz_si256(v, v)) {
+      return true;
+    }
+  }
+
+  for (; i < size; i++) {
+    if (bytes[i]) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+#define BIT_KERNELS_AVX2_BINARY(name, op, scalar_op)                           \
+  __attribute__((target("avx2"))) static void name(                            \
+      byte_type *dst, const byte_type *src, size_t size) {                     \
+    size_t i = 0;                                                              \
+    for (; i + avx2_words <= size; i += avx2_words) {                          \
+      const __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));        \
+      const __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));        \
+      _mm256_storeu_si256((__m256i *)(dst + i), op(a, b));                     \
+    }                                                                          \
+    for (; i < size; i++) {                                                    \
+      dst[i] scalar_op src[i];                                                 \
+    }                                                                          \
+  }
+
+BIT_KERNELS_AVX2_BINARY(and_avx2, _mm256_and_si256, &=)
+BIT_KERNELS_AVX2_BINARY(or_avx2, _mm256_or_si256, |=)
+BIT_KERNELS_AVX2_BINARY(xor_avx2, _mm256_xor_si256, ^=)
+
+__attribute__((target("avx2"))) static void
+not_avx2(byte_type *dst, const byte_type *src, size_t size) {
+  const __m256i ones = _mm256_set1_epi8(-1);
+  size_t i = 0;
+
+  for (; i + avx2_words <= size; i += avx2_words) {
+    const __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, ones));
+  }
+
+  for (; i < size; i++) {
+    dst[i] = ~src[i];
+  }
+}
+
+__attribute__((target("avx2"))) static size_t
+mismatch_avx2(const byte_type *a, const byte_type *b, size_t size) {
+  size_t i = 0;
+
+  for (; i + avx2_words <= size; i += avx2_words) {
+    const __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    const int eq = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(va, vb)));
+
+    if (eq != 0xf) {
+      return i + __builtin_ctz(~eq);
+    }
+  }
+
+  return i + mismatch_generic(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx2"))) static void
+fill_avx2(byte_type *bytes, size_t size, byte_type value) {
+  const __m256i v = _mm256_set1_epi64x(value);
+  size_t i = 0;
+
+  for (; i + avx2_words <= size; i += avx2_words) {
+    _mm256_storeu_si256((__m256i *)(bytes + i), v);
+  }
+
+  for (; i < size; i++) {
+    bytes[i] = value;
+  }
+}
+
+// Query word is broadcast and compared with one word of 8 vectors at once
+__attribute__((target("avx2"))) static void
+hamming_avx2(const byte_type *blocks, size_t words, const byte_type *query,
+             uint32_t *out, size_t size) {
+  constexpr size_t lanes = BitKernels::hamming_lanes;
+  const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+  for (size_t b = 0; b < size; b++, blocks += words * lanes) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+
+    for (size_t j = 0; j < words; j++) {
+      const __m256i q = _mm256_set1_epi64x(query[j]);
+      const __m256i *row = (const __m256i *)(blocks + j * lanes);
+
+      acc0 = _mm256_add_epi64(
+          acc0, popcount_avx2(_mm256_xor_si256(_mm256_loadu_si256(row), q)));
+      acc1 = _mm256_add_epi64(
+          acc1,
+          popcount_avx2(_mm256_xor_si256(_mm256_loadu_si256(row + 1), q)));
+    }
+
+    // Low halves of 64-bit lanes are the counts
+    _mm_storeu_si128((__m128i *)(out + b * lanes),
+                     _mm256_castsi256_si128(
+                         _mm256_permutevar8x32_epi32(acc0, even)));
+    _mm_storeu_si128((__m128i *)(out + b * lanes + 4),
+                     _mm256_castsi256_si128(
+                         _mm256_permutevar8x32_epi32(acc1, even)));
+  }
+}
+
+// Fields are gathered by unaligned 8-byte loads at the byte of their first
+// bit, the load covers 7 + 32 bits, so one shift puts the field in place
+__attribute__((target("avx2"))) static void
+unpack_avx2(const byte_type *bytes, size_t pos, int width, uint32_t *out,
+            size_t size) {
+  const long long *base = reinterpret_cast<const long long *>(bytes);
+  const __m256i mask = _mm256_set1_epi64x((1L << width) - 1);
+  const __m256i seven = _mm256_set1_epi64x(7);
+  const __m256i step = _mm256_set1_epi64x(4L * width);
+  const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+  __m256i bits = _mm256_add_epi64(
+      _mm256_set1_epi64x(pos),
+      _mm256_setr_epi64x(0, width, 2L * width, 3L * width));
+  size_t j = 0;
+
+  for (; j + 4 <= size; j += 4) {
+    const __m256i words =
+        _mm256_i64gather_epi64(base, _mm256_srli_epi64(bits, 3), 1);
+    const __m256i fields = _mm256_and_si256(
+        _mm256_srlv_epi64(words, _mm256_and_si256(bits, seven)), mask);
+
+    // Low halves of 64-bit lanes are the 32-bit fields
+    const __m256i packed = _mm256_permutevar8x32_epi32(fields, even);
+    _mm_storeu_si128((__m128i *)(out + j), _mm256_castsi256_si128(packed));
+
+    bits = _mm256_add_epi64(bits, step);
+  }
+
+  unpack_generic(bytes, pos + j * width, width, out + j, size - j);
+}
+
+// AVX-512
+
+static constexpr size_t avx512_words = sizeof(__m512i) / sizeof(byte_type);
+
+__attribute__((target("avx512f"))) static inline size_t
+reduce_avx512(__m512i v) {
+  byte_type lanes[avx512_words];
+  _mm512_storeu_si512(lanes, v);
+
+  size_t sum = 0;
+  for (const byte_type lane : lanes) {
+    sum += lane;
+  }
+
+  return sum;
+}
+
+// Bit counts of every byte of 'v', summed into 8 64-bit lanes
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+popcount_avx512bw(__m512i v) {
+  // Bit counts of nibbles 0..15, repeated in every 128-bit lane
+  const __m512i lookup =
+      _mm512_set4_epi64(0x0403030203020201, 0x0302020102010100,
+                        0x0403030203020201, 0x0302020102010100);
+  const __m512i low_mask = _mm512_set1_epi8(0x0f);
+
+  const __m512i lo = _mm512_and_si512(v, low_mask);
+  const __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low_mask);
+  const __m512i cnt = _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo),
+                                      _mm512_shuffle_epi8(lookup, hi));
+
+  return _mm512_sad_epu8(cnt, _mm512_setzero_si512());
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) static size_t
+count_avx512bw(const byte_type *bytes, size_t size) {
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+
+  for (; i + avx512_words <= size; i += avx512_words) {
+    acc = _mm512_add_epi64(acc,
+                           popcount_avx512bw(_mm512_loadu_si512(bytes + i)));
+  }
+
+  size_t count = reduce_avx512(acc);
+
+  for (; i < size; i++) {
+    count += __builtin_popcountl(bytes[i]);
+  }
+
+  return count;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) static size_t
+count_avx512vpopcnt(const byte_type *bytes, size_t size) {
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+
+  for (; i + avx512_words <= size; i += avx512_words) {
+    const __m512i v = _mm512_loadu_si512(bytes + i);
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+  }
+
+  size_t count = reduce_avx512(acc);
+
+  for (; i < size; i++) {
+    count += __builtin_popcountl(bytes[i]);
+  }
+
+  return count;
+}
+
+// One 512-bit register holds a word of all 8 vectors of a block
+#define BIT_KERNELS_AVX512_HAMMING(name, target_isa, popcount)                \
+  __attribute__((target(target_isa))) static void name(                       \
+      const byte_type *blocks, size_t words, const byte_type *query,          \
+      uint32_t *out, size_t size) {                                           \
+    constexpr size_t lanes = BitKernels::hamming_lanes;                       \
+    for (size_t b = 0; b < size; b++, blocks += words * lanes) {              \
+      __m512i acc = _mm512_setzero_si512();                                   \
+      for (size_t j = 0; j < words; j++) {                                    \
+        const __m512i v = _mm512_xor_si512(                                   \
+            _mm512_loadu_si512(blocks + j * lanes),                           \
+            _mm512_set1_epi64(query[j]));                                     \
+        acc = _mm512_add_epi64(acc, popcount(v));                             \
+      }                                                                       \
+      _mm256_storeu_si256((__m256i *)(out + b * lanes),                       \
+                          _mm512_cvtepi64_epi32(acc));                        \
+    }                                                                         \
+  }
+
+BIT_KERNELS_AVX512_HAMMING(hamming_avx512bw, "avx512f,avx512bw",
+                           popcount_avx512bw)
+BIT_KERNELS_AVX512_HAMMING(hamming_avx512vpopcnt, "avx512f,avx512vpopcntdq",
+                           _mm512_popcnt_epi64)
+
+#undef BIT_KERNELS_AVX512_HAMMING
+
+__attribute__((target("avx512f"))) static bool any_avx512(const byte_type *bytes,
+                                                          size_t size) {
+  size_t i = 0;
+
+  for (; i + 2 * avx512_words <= size; i += 2 * avx512_words) {
+    const __m512i v = _mm512_or_si512(
+        _mm512_loadu_si512(bytes + i),
+        _mm512_loadu_si512(bytes + i + avx512_words));
+
+    if (_mm512_test_epi64_mask(v, v)) {
+      return true;
+    }
+  }
+
+  for (; i < size; i++) {
+    if (bytes[i]) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+#define BIT_KERNELS_AVX512_BINARY(name, op, scalar_op)                         \
+  __attribute__((target("avx512f"))) static void name(                         \
+      byte_type *dst, const byte_type *src, size_t size) {                     \
+    size_t i = 0;                                                              \
+    for (; i + avx512_words <= size; i += avx512_words) {                      \
+      const __m512i a = _mm512_loadu_si512(dst + i);                           \
+      const __m512i b = _mm512_loadu_si512(src + i);                           \
+      _mm512_storeu_si512(dst + i, op(a, b));                                  \
+    }                                                                          \
+    for (; i < size; i++) {                                                    \
+      dst[i] scalar_op src[i];                                                 \
+    }                                                                          \
+  }
+
+BIT_KERNELS_AVX512_BINARY(and_avx512, _mm512_and_si512, &=)
+BIT_KERNELS_AVX512_BINARY(or_avx512, _mm512_or_si512, |=)
+BIT_KERNELS_AVX512_BINARY(xor_avx512, _mm512_xor_si512, ^=)
+
+__attribute__((target("avx512f"))) static void
+not_avx512(byte_type *dst, const byte_type *src, size_t size) {
+  const __m512i ones = _mm512_set1_epi64(-1);
+  size_t i = 0;
+
+  for (; i + avx512_words <= size; i += avx512_words) {
+    const __m512i a = _mm512_loadu_si512(src + i);
+    _mm512_storeu_si512(dst + i, _mm512_xor_si512(a, ones));
+  }
+
+  for (; i < size; i++) {
+    dst[i] = ~src[i];
+  }
+}
+
+__attribute__((target("avx512f"))) static size_t
+mismatch_avx512(const byte_type *a, const byte_type *b, size_t size) {
+  size_t i = 0;
+
+  for (; i + avx512_words <= size; i += avx512_words) {
+    const __mmask8 ne = _mm512_cmpneq_epi64_mask(_mm512_loadu_si512(a + i),
+                                                 _mm512_loadu_si512(b + i));
+
+    if (ne) {
+      return i + __builtin_ctz(ne);
+    }
+  }
+
+  return i + mismatch_generic(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx512f"))) static void
+fill_avx512(byte_type *bytes, size_t size, byte_type value) {
+  const __m512i v = _mm512_set1_epi64(value);
+  size_t i = 0;
+
+  for (; i + avx512_words <= size; i += avx512_words) {
+    _mm512_storeu_si512(bytes + i, v);
+  }
+
+  for (; i < size; i++) {
+    bytes[i] = value;
+  }
+}
+
+#endif
+
+// Dispatch
+
+const BitKernels::Table *BitKernels::select(Isa isa) {
+  static const Table generic = {
+      Isa::generic,   count_generic, any_generic,      and_generic, or_generic,
+      xor_generic,    not_generic,   mismatch_generic, fill_generic,
+      unpack_generic, pack_generic,  hamming_generic,
+  };
+
+#ifdef BIT_KERNELS_X86
+  static const Table popcnt = {
+      Isa::popcnt,    count_popcnt, any_generic,      and_generic, or_generic,
+      xor_generic,    not_generic,  mismatch_generic, fill_generic,
+      unpack_generic, pack_generic, hamming_popcnt,
+  };
+  static const Table avx2 = {
+      Isa::avx2,   count_avx2,   any_avx2,      and_avx2, or_avx2,
+      xor_avx2,    not_avx2,     mismatch_avx2, fill_avx2,
+      unpack_avx2, pack_generic, hamming_avx2,
+  };
+  static const Table avx512bw = {
+      Isa::avx512, count_avx512bw, any_avx512,      and_avx512, or_avx512,
+      xor_avx512,  not_avx512,     mismatch_avx512, fill_avx512,
+      unpack_avx2, pack_generic,   hamming_avx512bw,
+  };
+  static const Table avx512vpopcnt = {
+      Isa::avx512, count_avx512vpopcnt, any_avx512,      and_avx512, or_avx512,
+      xor_avx512,  not_avx512,          mismatch_avx512, fill_avx512,
+      unpack_avx2, pack_generic,        hamming_avx512vpopcnt,
+  };
+
+  __builtin_cpu_init();
+
+  switch (isa) {
+  case Isa::generic:
+    return &generic;
+  case Isa::popcnt:
+    return __builtin_cpu_supports("popcnt") ? &popcnt : nullptr;
+  case Isa::avx2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")
+               ? &avx2
+               : nullptr;
+  case Isa::avx512:
+    if (!__builtin_cpu_supports("avx512f") ||
+        !__builtin_cpu_supports("popcnt")) {
+      return nullptr;
+    }
+    if (__builtin_cpu_supports("avx512vpopcntdq")) {
+      return &avx512vpopcnt;
+    }
+    return __builtin_cpu_supports("avx512bw") ? &avx512bw : nullptr;
+  }
+#endif
+
+  return isa == Isa::generic ? &generic : nullptr;
+}
+
+const BitKernels::Table *BitKernels::detect() {
+  for (const Isa isa : {Isa::avx512, Isa::avx2, Isa::popcnt}) {
+    if (const Table *table = select(isa)) {
+      return table;
+    }
+  }
+
+  return select(Isa::generic);
+}
+
+const BitKernels::Table *&BitKernels::current() {
+  static const Table *table = detect();
+  return table;
+}
+
+BitKernels::Parallel &BitKernels::parallel() {
+  static Parallel config = {std::max(std::thread::hardware_concurrency(), 1U),
+                            default_parallel_threshold};
+  return config;
+}
+
+void BitKernels::run_parts(size_t size, unsigned parts,
+                           void (*fn)(void *ctx, size_t begin, size_t end),
+                           void *ctx) {
+  // Parts start at cache line boundaries, so threads don't share lines
+  const size_t line = 64 / sizeof(byte_type);
+  const size_t step = (size / parts + line - 1) / line * line;
+
+  std::vector<std::thread> workers;
+  workers.reserve(parts - 1);
+
+  const auto join = [&workers] {
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  };
+
+  try {
+    for (unsigned part = 1; part < parts && part * step < size; part++) {
+      workers.emplace_back(fn, ctx, part * step,
+                           std::min((part + 1) * step, size));
+    }
+  } catch (...) {
+    join();
+    throw;
+  }
+
+  fn(ctx, 0, std::min(step, size));
+  join();
+}
+
+BitKernels::Isa BitKernels::isa() { return current()->isa; }
+
+bool BitKernels::supported(Isa isa) { return select(isa) != nullptr; }
+
+void BitKernels::use(Isa isa) {
+  const Table *table = select(isa);
+
+  if (table == nullptr) {
+    throw std::invalid_argument("Instruction set is not supported by CPU");
+  }
+
+  current() = table;
+}
+
+void BitKernels::set_threads(unsigned threads) {
+  parallel().threads =
+      threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+unsigned BitKernels::threads() { return parallel().threads; }
+
+void BitKernels::set_parallel_threshold(size_t size) {
+  parallel().threshold = size;
+}
+
+size_t BitKernels::parallel_threshold() { return parallel().threshold; }
+
+size_t BitKernels::count(const byte_type *bytes, size_t size) {
+  const Table *table = current();
+
+  // Short ranges skip atomics, rank/select counts a few words at a time
+  if (size < parallel().threshold) {
+    return table->count(bytes, size);
+  }
+
+  std::atomic<size_t> total(0);
+
+  for_each_part(size, [&](size_t begin, size_t end) {
+    total += table->count(bytes + begin, end - begin);
+  });
+
+  return total;
+}
+
+bool BitKernels::any(const byte_type *bytes, size_t size) {
+  const Table *table = current();
+
+  if (size < parallel().threshold) {
+    return table->any(bytes, size);
+  }
+
+  std::atomic<bool> found(false);
+
+  for_each_part(size, [&](size_t begin, size_t end) {
+    if (!found.load(std::memory_order_relaxed) &&
+        table->any(bytes + begin, end - begin)) {
+      found = true;
+    }
+  });
+
+  return found;
+}
+
+void BitKernels::bit_and(byte_type *dst, const byte_type *src, size_t size) {
+  const Table *table = current();
+
+  for_each_part(size, [&](size_t begin, size_t end) {
+    table->bit_and(dst + begin, src + begin, end - begin);
+  });
+}
+
+void BitKernels::bit_or(byte_type *dst, const byte_type *src, size_t size) {
+  const Table *table = current();
+
+  for_each_part(size, [&](size_t begin, size_t end) {
+    table->bit_or(dst + begin, src + begin, end - begin);
+  });
+}
+
+void BitKernels::bit_xor(byte_type *dst, const byte_type *src, size_t size) {
+  const Table *table = current();
+
+  for_each_part(size, [&](size_t begin, size_t end) {
+    table->bit_xor(dst + begin, src + begin, end - begin);
+  });
+}
+
+void BitKernels::bit_not(byte_type *dst, const byte_type *src, size_t size) {
+  const Table *table = current();
+
+  for_each_part(size, [&](size_t begin, size_t end) {
+    table->bit_not(dst + begin, src + begin, end - begin);
+  });
+}
+
+size_t BitKernels::mismatch(const byte_type *a, const byte_type *b,
+                            size_t size) {
+  return current()->mismatch(a, b, size);
+}
+
+void BitKernels::fill(byte_type *bytes, size_t size, byte_type value) {
+  const Table *table = current();
+
+  for_each_part(size, [&](size_t begin, size_t end) {
+    table->fill(bytes + begin, end - begin, value);
+  });
+}
+
+void BitKernels::unpack(const byte_type *bytes, size_t pos, int width,
+                        uint32_t *out, size_t size) {
+  current()->unpack(bytes, pos, width, out, size);
+}
+
+void BitKernels::pack(byte_type *bytes, size_t pos, int width,
+                      const uint32_t *in, size_t size) {
+  current()->pack(bytes, pos, width, in, size);
+}
+
+void BitKernels::hamming(const byte_type *blocks, size_t words,
+                         const byte_type *query, uint32_t *out, size_t size) {
+  current()->hamming(blocks, words, query, out, size);
+}
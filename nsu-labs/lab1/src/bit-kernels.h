@@ -0,0 +1,147 @@
+#ifndef BIT_KERNELS
+#define BIT_KERNELS
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+using byte_type = ulong;
+
+// Bulk operations over arrays of 'byte_type' words
+// Implementation is picked once at startup by the instruction set of the CPU
+// Large arrays are split into parts, which are processed by several threads
+class BitKernels {
+public:
+  enum class Isa { generic, popcnt, avx2, avx512 };
+
+private:
+  struct Table {
+    Isa isa;
+    size_t (*count)(const byte_type *bytes, size_t size);
+    bool (*any)(const byte_type *bytes, size_t size);
+    void (*bit_and)(byte_type *dst, const byte_type *src, size_t size);
+    void (*bit_or)(byte_type *dst, const byte_type *src, size_t size);
+    void (*bit_xor)(byte_type *dst, const byte_type *src, size_t size);
+    void (*bit_not)(byte_type *dst, const byte_type *src, size_t size);
+    size_t (*mismatch)(const byte_type *a, const byte_type *b, size_t size);
+    void (*fill)(byte_type *bytes, size_t size, byte_type value);
+    void (*unpack)(const byte_type *bytes, size_t pos, int width,
+                   uint32_t *out, size_t size);
+    void (*pack)(byte_type *bytes, size_t pos, int width, const uint32_t *in,
+                 size_t size);
+    void (*hamming)(const byte_type *blocks, size_t words,
+                    const byte_type *query, uint32_t *out, size_t size);
+  };
+
+  struct Parallel {
+    unsigned threads;
+    size_t threshold;
+  };
+
+  static const Table *select(Isa isa);
+  static const Table *detect();
+  static const Table *&current();
+
+  static Parallel &parallel();
+
+  // Split range [0, size) into 'parts' parts and call fn(ctx, begin, end)
+  // for each of them, all but one part in new threads
+  static void run_parts(size_t size, unsigned parts,
+                        void (*fn)(void *ctx, size_t begin, size_t end),
+                        void *ctx);
+
+  BitKernels() = delete;
+
+public:
+  // Currently used instruction set
+  static Isa isa();
+
+  // True, if instruction set is supported by the CPU
+  static bool supported(Isa isa);
+
+  // Switch implementation, throws if instruction set is not supported
+  // Not thread-safe, intended for tests and benchmarks
+  static void use(Isa isa);
+
+  // Arrays of less words are always processed in the calling thread
+  static constexpr size_t default_parallel_threshold = 1 << 20;
+
+  // Number of threads for large arrays, 0 means all hardware threads
+  // Not thread-safe, like use()
+  static void set_threads(unsigned threads);
+  static unsigned threads();
+
+  // Smallest size in words, which is processed in parallel
+  static void set_parallel_threshold(size_t size);
+  static size_t parallel_threshold();
+
+  // Call f(begin, end) for parts of range [0, size), which cover it
+  // Parts are processed in parallel, if size is at least 'threshold', so f
+  // must not write to shared data without synchronization
+  template <class F>
+  static void for_each_part(size_t size, F f,
+                            size_t threshold = parallel_threshold());
+
+  // Count bits of value 1
+  static size_t count(const byte_type *bytes, size_t size);
+
+  // True, if at least one bit of value 1
+  static bool any(const byte_type *bytes, size_t size);
+
+  // dst[i] = dst[i] & src[i]
+  static void bit_and(byte_type *dst, const byte_type *src, size_t size);
+
+  // dst[i] = dst[i] | src[i]
+  static void bit_or(byte_type *dst, const byte_type *src, size_t size);
+
+  // dst[i] = dst[i] ^ src[i]
+  static void bit_xor(byte_type *dst, const byte_type *src, size_t size);
+
+  // dst[i] = ~src[i], dst and src may be the same array
+  static void bit_not(byte_type *dst, const byte_type *src, size_t size);
+
+  // Index of the first word, which differs in 'a' and 'b', or 'size'
+  static size_t mismatch(const byte_type *a, const byte_type *b, size_t size);
+
+  // Fill all words with 'value'
+  static void fill(byte_type *bytes, size_t size, byte_type value);
+
+  // out[j] = j'th field of 'width' bits (1 to 32), which start at bit 'pos'
+  // Fields are read by 8-byte loads, so one word after the last field must
+  // be readable
+  static void unpack(const byte_type *bytes, size_t pos, int width,
+                     uint32_t *out, size_t size);
+
+  // Write fields in[j] of 'width' bits (1 to 32) from bit 'pos', other bits
+  // are kept. Values must fit into 'width' bits
+  static void pack(byte_type *bytes, size_t pos, int width, const uint32_t *in,
+                   size_t size);
+
+  // Vectors, which hamming() compares, are kept in blocks of so many
+  // vectors, word j of vector v of a block is block[j * hamming_lanes + v]
+  static constexpr size_t hamming_lanes = 8;
+
+  // out[b * hamming_lanes + v] = number of bits, which differ in 'query' of
+  // 'words' words and vector v of b'th of 'size' blocks
+  static void hamming(const byte_type *blocks, size_t words,
+                      const byte_type *query, uint32_t *out, size_t size);
+};
+
+template <class F>
+void BitKernels::for_each_part(size_t size, F f, size_t threshold) {
+  const Parallel &config = parallel();
+
+  if (size < threshold || config.threads <= 1) {
+    f(size_t(0), size);
+    return;
+  }
+
+  run_parts(
+      size, config.threads,
+      [](void *ctx, size_t begin, size_t end) {
+        (*static_cast<F *>(ctx))(begin, end);
+      },
+      &f);
+}
+
+#endif
@@ -0,0 +1,417 @@
+#include "bit-span.h"
+#include "bit-array.h"
+#include "mapped-bit-array.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+// Operations for BitSpan::apply(), whole bytes of aligned views go to
+// kernels
+namespace {
+
+struct SpanAnd {
+  static byte_type apply(byte_type a, byte_type b) { return a & b; }
+  static void kernel(byte_type *dst, const byte_type *src, size_t size) {
+    BitKernels::bit_and(dst, src, size);
+  }
+};
+
+struct SpanOr {
+  static byte_type apply(byte_type a, byte_type b) { return a | b; }
+  static void kernel(byte_type *dst, const byte_type *src, size_t size) {
+    BitKernels::bit_or(dst, src, size);
+  }
+};
+
+struct SpanXor {
+  static byte_type apply(byte_type a, byte_type b) { return a ^ b; }
+  static void kernel(byte_type *dst, const byte_type *src, size_t size) {
+    BitKernels::bit_xor(dst, src, size);
+  }
+};
+
+struct SpanCopy {
+  static byte_type apply(byte_type, byte_type b) { return b; }
+  static void kernel(byte_type *dst, const byte_type *src, size_t size) {
+    std::memmove(dst, src, size * sizeof(byte_type));
+  }
+};
+
+} // namespace
+
+// ConstBitSpan
+
+byte_type ConstBitSpan::byte_mask(size_t i) const {
+  const int trail = bits % byte_bits;
+  return i + 1 == byte_count() && trail > 0 ? (1UL << trail) - 1 : ~0UL;
+}
+
+void ConstBitSpan::check(size_t n, const char *msg) const {
+  if (n >= bits) {
+    throw std::out_of_range(msg);
+  }
+}
+
+size_t ConstBitSpan::find_from(size_t from, byte_type flip) const {
+  if (from >= bits) {
+    return npos;
+  }
+
+  const size_t size = byte_count();
+  size_t byte_pos = from / byte_bits;
+
+  // Drop bits before 'from' in the first byte
+  byte_type byte = (this->byte(byte_pos) ^ flip) & byte_mask(byte_pos) &
+                   (~0UL << (from % byte_bits));
+
+  while (!byte && ++byte_pos < size) {
+    byte = (this->byte(byte_pos) ^ flip) & byte_mask(byte_pos);
+  }
+
+  if (!byte) {
+    return npos;
+  }
+
+  return byte_pos * byte_bits + __builtin_ctzl(byte);
+}
+
+size_t ConstBitSpan::find_to(size_t to, byte_type flip) const {
+  if (to >= bits) {
+    return npos;
+  }
+
+  size_t byte_pos = to / byte_bits;
+
+  // Drop bits after 'to' in the last byte
+  byte_type byte = (this->byte(byte_pos) ^ flip) & byte_mask(byte_pos) &
+                   (~0UL >> (byte_bits - 1 - to % byte_bits));
+
+  while (!byte && byte_pos > 0) {
+    byte_pos--;
+    byte = (this->byte(byte_pos) ^ flip) & byte_mask(byte_pos);
+  }
+
+  if (!byte) {
+    return npos;
+  }
+
+  return byte_pos * byte_bits + byte_bits - 1 - __builtin_clzl(byte);
+}
+
+ConstBitSpan::ConstBitSpan() : bytes(nullptr), offset(0), bits(0) {}
+
+ConstBitSpan::ConstBitSpan(const byte_type *bytes, size_t offset, size_t size)
+    : bytes(bytes + offset / byte_bits), offset(offset % byte_bits),
+      bits(size) {}
+
+ConstBitSpan::ConstBitSpan(const BitArray &b)
+    : ConstBitSpan(b.data(), 0, b.size()) {}
+
+ConstBitSpan::ConstBitSpan(const MappedBitArray &b)
+    : ConstBitSpan(b.data(), 0, b.size()) {}
+
+byte_type ConstBitSpan::byte(size_t i) const {
+  if (i >= byte_count()) {
+    return 0;
+  }
+
+  if (aligned()) {
+    return bytes[i] & byte_mask(i);
+  }
+
+  byte_type byte = bytes[i] >> offset;
+
+  if (i + 1 < raw_count()) {
+    byte |= bytes[i + 1] << (byte_bits - offset);
+  }
+
+  return byte & byte_mask(i);
+}
+
+ConstBitSpan ConstBitSpan::subspan(size_t pos, size_t len) const {
+  if (pos > bits) {
+    throw std::out_of_range("Unable to make subspan: pos is out of range");
+  }
+
+  return ConstBitSpan(bytes, offset + pos, std::min(len, bits - pos));
+}
+
+bool ConstBitSpan::get(size_t i) const {
+  check(i, "Unable to get: i is out of range");
+
+  const size_t pos = offset + i;
+  return (bytes[pos / byte_bits] >> (pos % byte_bits)) & 1UL;
+}
+
+bool ConstBitSpan::operator[](size_t i) const { return get(i); }
+
+size_t ConstBitSpan::count() const {
+  if (bits == 0) {
+    return 0;
+  }
+
+  const size_t end = offset + bits;
+  const size_t last = (end - 1) / byte_bits;
+  const byte_type head = ~0UL << offset;
+  const byte_type tail = end % byte_bits ? (1UL << end % byte_bits) - 1 : ~0UL;
+
+  if (last == 0) {
+    return __builtin_popcountl(bytes[0] & head & tail);
+  }
+
+  return __builtin_popcountl(bytes[0] & head) +
+         BitKernels::count(bytes + 1, last - 1) +
+         __builtin_popcountl(bytes[last] & tail);
+}
+
+bool ConstBitSpan::any() const {
+  if (bits == 0) {
+    return false;
+  }
+
+  const size_t end = offset + bits;
+  const size_t last = (end - 1) / byte_bits;
+  const byte_type head = ~0UL << offset;
+  const byte_type tail = end % byte_bits ? (1UL << end % byte_bits) - 1 : ~0UL;
+
+  if (last == 0) {
+    return bytes[0] & head & tail;
+  }
+
+  return (bytes[0] & head) || (bytes[last] & tail) ||
+         BitKernels::any(bytes + 1, last - 1);
+}
+
+bool ConstBitSpan::none() const { return !any(); }
+
+size_t ConstBitSpan::find_first() const { return find_from(0, 0); }
+
+size_t ConstBitSpan::find_last() const {
+  return empty() ? npos : find_to(bits - 1, 0);
+}
+
+size_t ConstBitSpan::find_next(size_t i) const {
+  check(i, "Unable to find next: i is out of range");
+  return find_from(i + 1, 0);
+}
+
+size_t ConstBitSpan::find_first_zero() const { return find_from(0, ~0UL); }
+
+size_t ConstBitSpan::find_last_zero() const {
+  return empty() ? npos : find_to(bits - 1, ~0UL);
+}
+
+size_t ConstBitSpan::find_next_zero(size_t i) const {
+  check(i, "Unable to find next zero: i is out of range");
+  return find_from(i + 1, ~0UL);
+}
+
+std::string ConstBitSpan::to_string() const {
+  std::string str(bits, '0');
+
+  for_each_set_bit([&](size_t i) { str[bits - 1 - i] = '1'; });
+
+  return str;
+}
+
+bool operator==(const ConstBitSpan &s1, const ConstBitSpan &s2) {
+  if (s1.size() != s2.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < s1.byte_count(); i++) {
+    if (s1.byte(i) != s2.byte(i)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool operator!=(const ConstBitSpan &s1, const ConstBitSpan &s2) {
+  return !(s1 == s2);
+}
+
+// BitSpan
+
+BitSpan::BitSpan(byte_type *bytes, size_t offset, size_t size,
+                 bool *index_valid)
+    : ConstBitSpan(bytes, offset, size), index_valid(index_valid) {}
+
+void BitSpan::invalidate() const {
+  if (index_valid != nullptr) {
+    *index_valid = false;
+  }
+}
+
+void BitSpan::store(size_t i, byte_type value, byte_type mask) const {
+  byte_type *raw = data();
+
+  if (aligned()) {
+    raw[i] = (raw[i] & ~mask) | (value & mask);
+    return;
+  }
+
+  const byte_type low = mask << offset;
+  const byte_type high = mask >> (byte_bits - offset);
+
+  raw[i] = (raw[i] & ~low) | ((value << offset) & low);
+
+  if (high) {
+    const byte_type rest = value >> (byte_bits - offset);
+    raw[i + 1] = (raw[i + 1] & ~high) | (rest & high);
+  }
+}
+
+void BitSpan::fill(byte_type value) const {
+  if (bits == 0) {
+    return;
+  }
+
+  invalidate();
+
+  byte_type *raw = data();
+  const size_t end = offset + bits;
+  const size_t last = (end - 1) / byte_bits;
+  byte_type head = ~0UL << offset;
+  const byte_type tail = end % byte_bits ? (1UL << end % byte_bits) - 1 : ~0UL;
+
+  if (last == 0) {
+    head &= tail;
+  }
+
+  raw[0] = (raw[0] & ~head) | (value & head);
+
+  if (last > 0) {
+    BitKernels::fill(raw + 1, last - 1, value);
+    raw[last] = (raw[last] & ~tail) | (value & tail);
+  }
+}
+
+template <class Op> void BitSpan::apply(const ConstBitSpan &s, Op) const {
+  if (bits != s.size()) {
+    throw std::invalid_argument(
+        "BitSpans must have the same size for bitwise operation");
+  }
+
+  const ConstBitSpan &src = s;
+  const byte_type *src_begin = src.bytes;
+  const byte_type *src_end = src.bytes + src.raw_count();
+  const byte_type *dst_begin = bytes;
+  const byte_type *dst_end = bytes + raw_count();
+
+  const std::less<const byte_type *> less;
+  const bool overlap = less(src_begin, dst_end) && less(dst_begin, src_end);
+  const size_t size = byte_count();
+
+  invalidate();
+
+  // Whole bytes go to kernels, the last one is masked
+  if (aligned() && src.aligned() && (!overlap || src_begin == dst_begin)) {
+    const size_t full = bits / byte_bits;
+    Op::kernel(data(), src_begin, full);
+
+    if (full < size) {
+      store(full, Op::apply(byte(full), src.byte(full)), byte_mask(full));
+    }
+    return;
+  }
+
+  // Bytes are written in the order, in which overlapping source is read
+  // before it is overwritten
+  const bool backward =
+      overlap && (less(src_begin, dst_begin) ||
+                  (src_begin == dst_begin && src.offset < offset));
+
+  for (size_t k = 0; k < size; k++) {
+    const size_t i = backward ? size - 1 - k : k;
+    store(i, Op::apply(byte(i), src.byte(i)), byte_mask(i));
+  }
+}
+
+BitSpan::BitSpan() : index_valid(nullptr) {}
+
+BitSpan::BitSpan(byte_type *bytes, size_t offset, size_t size)
+    : BitSpan(bytes, offset, size, nullptr) {}
+
+BitSpan BitSpan::subspan(size_t pos, size_t len) const {
+  if (pos > bits) {
+    throw std::out_of_range("Unable to make subspan: pos is out of range");
+  }
+
+  return BitSpan(data(), offset + pos, std::min(len, bits - pos), index_valid);
+}
+
+const BitSpan &BitSpan::set(size_t n, bool val) const {
+  check(n, "Unable to set: n is out of range");
+
+  invalidate();
+
+  const size_t pos = offset + n;
+  byte_type &byte = data()[pos / byte_bits];
+  const byte_type mask = 1UL << (pos % byte_bits);
+
+  byte = val ? byte | mask : byte & ~mask;
+
+  return *this;
+}
+
+const BitSpan &BitSpan::set() const {
+  fill(~0UL);
+  return *this;
+}
+
+const BitSpan &BitSpan::reset(size_t n) const { return set(n, false); }
+
+const BitSpan &BitSpan::reset() const {
+  fill(0);
+  return *this;
+}
+
+const BitSpan &BitSpan::flip() const {
+  if (bits == 0) {
+    return *this;
+  }
+
+  invalidate();
+
+  byte_type *raw = data();
+  const size_t end = offset + bits;
+  const size_t last = (end - 1) / byte_bits;
+  byte_type head = ~0UL << offset;
+  const byte_type tail = end % byte_bits ? (1UL << end % byte_bits) - 1 : ~0UL;
+
+  if (last == 0) {
+    head &= tail;
+  }
+
+  raw[0] ^= head;
+
+  if (last > 0) {
+    BitKernels::bit_not(raw + 1, raw + 1, last - 1);
+    raw[last] ^= tail;
+  }
+
+  return *this;
+}
+
+const BitSpan &BitSpan::assign(const ConstBitSpan &s) const {
+  apply(s, SpanCopy());
+  return *this;
+}
+
+const BitSpan &BitSpan::operator&=(const ConstBitSpan &s) const {
+  apply(s, SpanAnd());
+  return *this;
+}
+
+const BitSpan &BitSpan::operator|=(const ConstBitSpan &s) const {
+  apply(s, SpanOr());
+  return *this;
+}
+
+const BitSpan &BitSpan::operator^=(const ConstBitSpan &s) const {
+  apply(s, SpanXor());
+  return *this;
+}
@@ -0,0 +1,171 @@
+#ifndef BIT_SPAN
+#define BIT_SPAN
+
+#include "bit-expr.h"
+#include "bit-kernels.h"
+#include <climits>
+#include <cstddef>
+#include <string>
+
+class BitArray;
+class MappedBitArray;
+
+// Non-owning view of 'size' bits, which start at any bit of a byte array
+// View is read by whole bytes, shifted to the start of the view, so byte(0)
+// holds bits [0, 64) of the view. Memory must outlive the view.
+class ConstBitSpan : public BitExpr<ConstBitSpan> {
+public:
+  static constexpr int byte_bits = sizeof(byte_type) * CHAR_BIT;
+
+  // Returned by queries, when there is no such position
+  static constexpr size_t npos = -1;
+
+protected:
+  const byte_type *bytes;
+  int offset;
+  size_t bits;
+
+  // Bytes of memory, which the view touches
+  size_t raw_count() const {
+    return (offset + bits + byte_bits - 1) / byte_bits;
+  }
+
+  // Bits of i'th byte of the view, which belong to it
+  byte_type byte_mask(size_t i) const;
+
+  // True, if bytes of the view are bytes of memory
+  bool aligned() const { return offset == 0; }
+
+  void check(size_t n, const char *msg) const;
+
+  size_t find_from(size_t from, byte_type flip) const;
+  size_t find_to(size_t to, byte_type flip) const;
+
+  // Reads memory of the source view in bitwise operations
+  friend class BitSpan;
+
+public:
+  // Views of shifted bytes may overlap the destination of an expression
+  static constexpr bool elementwise = false;
+
+  ConstBitSpan();
+
+  // View of bits [offset, offset + size) of byte array
+  ConstBitSpan(const byte_type *bytes, size_t offset, size_t size);
+
+  // View of the whole array
+  ConstBitSpan(const BitArray &b);
+  ConstBitSpan(const MappedBitArray &b);
+
+  size_t size() const { return bits; }
+  bool empty() const { return bits == 0; }
+
+  // Number of bytes, byte(i) returns
+  size_t byte_count() const { return (bits + byte_bits - 1) / byte_bits; }
+
+  // Return i'th byte of the view, 0 if it is out of range
+  byte_type byte(size_t i) const;
+
+  // View of bits [pos, pos + len), len is cut at the end of the view
+  ConstBitSpan subspan(size_t pos, size_t len = npos) const;
+
+  // Return i'th bit value
+  bool get(size_t i) const;
+  bool operator[](size_t i) const;
+
+  // Count bits of value 1
+  size_t count() const;
+
+  // True, if at least one bit of value 1
+  bool any() const;
+
+  // True, if all bits are 0's
+  bool none() const;
+
+  // Position of the first (last) bit of value 1, or npos
+  size_t find_first() const;
+  size_t find_last() const;
+
+  // Position of the first bit of value 1 after i'th bit, or npos
+  size_t find_next(size_t i) const;
+
+  // Position of the first (last) bit of value 0, or npos
+  size_t find_first_zero() const;
+  size_t find_last_zero() const;
+
+  // Position of the first bit of value 0 after i'th bit, or npos
+  size_t find_next_zero(size_t i) const;
+
+  // Call f(i) for every bit of value 1 in ascending order
+  template <class F> void for_each_set_bit(F f) const {
+    const size_t size = byte_count();
+
+    for (size_t byte_pos = 0; byte_pos < size; byte_pos++) {
+      for (byte_type byte = this->byte(byte_pos); byte; byte &= byte - 1) {
+        f(byte_pos * byte_bits + __builtin_ctzl(byte));
+      }
+    }
+  }
+
+  // Return string representation of the view
+  std::string to_string() const;
+};
+
+bool operator==(const ConstBitSpan &s1, const ConstBitSpan &s2);
+bool operator!=(const ConstBitSpan &s1, const ConstBitSpan &s2);
+
+// View, which can change the bits
+class BitSpan : public ConstBitSpan {
+private:
+  // Validity flag of the rank/select directory of the viewed bit array
+  bool *index_valid;
+
+  friend class BitArray;
+  BitSpan(byte_type *bytes, size_t offset, size_t size, bool *index_valid);
+
+  byte_type *data() const { return const_cast<byte_type *>(bytes); }
+
+  void invalidate() const;
+
+  // Write bits of 'mask' of i'th byte of the view
+  void store(size_t i, byte_type value, byte_type mask) const;
+
+  // Fill bits with 'value' by whole bytes of memory
+  void fill(byte_type value) const;
+
+  template <class Op> void apply(const ConstBitSpan &s, Op op) const;
+
+public:
+  BitSpan();
+
+  // View of bits [offset, offset + size) of byte array
+  BitSpan(byte_type *bytes, size_t offset, size_t size);
+
+  // View of bits [pos, pos + len), len is cut at the end of the view
+  BitSpan subspan(size_t pos, size_t len = npos) const;
+
+  // Set n'th bit to 'value'
+  const BitSpan &set(size_t n, bool val = true) const;
+
+  // Fill view with 1's
+  const BitSpan &set() const;
+
+  // Set n'th bit to 0
+  const BitSpan &reset(size_t n) const;
+
+  // Fill view with 0's
+  const BitSpan &reset() const;
+
+  // Invert all bits
+  const BitSpan &flip() const;
+
+  // Copy bits of the view of the same size
+  const BitSpan &assign(const ConstBitSpan &s) const;
+
+  // Bit operators for views of the same size
+  const BitSpan &operator&=(const ConstBitSpan &s) const;
+  const BitSpan &operator|=(const ConstBitSpan &s) const;
+  const BitSpan &operator^=(const ConstBitSpan &s) const;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "bit-stream.h"
+#include <stdexcept>
+
+// Writer
+
+BitWriter::BitWriter(BitArray &ba) : ba(ba), buffer(0), buffered(0) {}
+
+// Errors are dropped, like in std::ofstream, flush() reports them
+BitWriter::~BitWriter() {
+  try {
+    flush();
+  } catch (...) {
+  }
+}
+
+BitWriter &BitWriter::write(uint64_t value, int n) {
+  if (n < 0 || n > 64) {
+    throw std::invalid_argument("Unable to write bits: n is out of range");
+  }
+
+  if (n < 64) {
+    value &= (1UL << n) - 1;
+  }
+
+  if (n == 0) {
+    return *this;
+  }
+
+  buffer |= value << buffered;
+
+  // Word is full, high bits of the field start the next one
+  if (buffered + n >= 64) {
+    ba.append_bits(buffer, 64);
+
+    const int used = 64 - buffered;
+    buffer = used < 64 ? value >> used : 0;
+    buffered = n - used;
+  } else {
+    buffered += n;
+  }
+
+  return *this;
+}
+
+BitWriter &BitWriter::write_bit(bool bit) { return write(bit, 1); }
+
+void BitWriter::flush() {
+  ba.append_bits(buffer, buffered);
+  buffer = 0;
+  buffered = 0;
+}
+
+// Reader
+
+BitReader::BitReader(const ConstBitSpan &span) : span(span), pos(0) {}
+
+uint64_t BitReader::read(int n) {
+  if (n < 0 || n > 64) {
+    throw std::invalid_argument("Unable to read bits: n is out of range");
+  }
+
+  if (size_t(n) > remaining()) {
+    throw std::out_of_range("Unable to read bits: end of stream");
+  }
+
+  if (n == 0) {
+    return 0;
+  }
+
+  const size_t byte_pos = pos / ConstBitSpan::byte_bits;
+  const int bit_pos = pos % ConstBitSpan::byte_bits;
+
+  uint64_t value = span.byte(byte_pos) >> bit_pos;
+
+  if (bit_pos + n > ConstBitSpan::byte_bits) {
+    value |= span.byte(byte_pos + 1) << (ConstBitSpan::byte_bits - bit_pos);
+  }
+
+  pos += n;
+
+  return n < 64 ? value & ((1UL << n) - 1) : value;
+}
+
+bool BitReader::read_bit() { return read(1); }
+
+void BitReader::seek(size_t position) {
+  if (position > span.size()) {
+    throw std::out_of_range("Unable to seek: position is out of range");
+  }
+
+  pos = position;
+}
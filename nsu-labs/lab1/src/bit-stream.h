@@ -0,0 +1,58 @@
+#ifndef BIT_STREAM
+#define BIT_STREAM
+
+#include "bit-array.h"
+#include <cstdint>
+
+// Writes bit fields at the end of a bit array
+// Fields are collected into a word, which is appended to the array when it
+// is full, so the array sees the last bits only after flush()
+class BitWriter {
+private:
+  BitArray &ba;
+  uint64_t buffer;
+  int buffered;
+
+public:
+  explicit BitWriter(BitArray &ba);
+
+  // Flushes buffered bits, errors are ignored
+  ~BitWriter();
+
+  BitWriter(const BitWriter &) = delete;
+  BitWriter &operator=(const BitWriter &) = delete;
+
+  // Write n lowest bits of 'value', 0 <= n <= 64
+  BitWriter &write(uint64_t value, int n);
+  BitWriter &write_bit(bool bit);
+
+  // Append buffered bits to the array
+  void flush();
+
+  // Number of bits in the array, including buffered ones
+  size_t size() const { return ba.size() + buffered; }
+};
+
+// Reads bit fields from a view, starting at bit 0
+class BitReader {
+private:
+  ConstBitSpan span;
+  size_t pos;
+
+public:
+  explicit BitReader(const ConstBitSpan &span);
+
+  // Read n bits into lowest bits of the result, 0 <= n <= 64
+  // Throws std::out_of_range, if less than n bits are left
+  uint64_t read(int n);
+  bool read_bit();
+
+  // Position of the next bit to read
+  size_t position() const { return pos; }
+  size_t remaining() const { return span.size() - pos; }
+
+  // Move to the position, which must not be after the end
+  void seek(size_t position);
+};
+
+#endif
@@ -0,0 +1,350 @@
+#include "bloom-filter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+
+constexpr int byte_bits = ConstBitSpan::byte_bits;
+
+// Bloom filters with more hashes are never optimal
+constexpr int max_hashes = 64;
+
+// Finalizer of MurmurHash3, every bit of the key changes half of the result
+uint64_t mix(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdUL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53UL;
+  key ^= key >> 33;
+  return key;
+}
+
+// Map hash to [0, n) by multiplication instead of division
+size_t reduce(uint64_t hash, size_t n) {
+  return (unsigned __int128)hash * n >> 64;
+}
+
+void check_hashes(int num_hashes) {
+  if (num_hashes <= 0 || num_hashes > max_hashes) {
+    throw std::invalid_argument("Number of hashes must be in [1, 64]");
+  }
+}
+
+void check_fpr(double fpr) {
+  if (!(fpr > 0 && fpr < 1)) {
+    throw std::invalid_argument("False positive rate must be in (0, 1)");
+  }
+}
+
+} // namespace
+
+// BloomFilter
+
+void BloomFilter::hash(uint64_t key, uint64_t &h1, uint64_t &h2) {
+  h1 = mix(key);
+  h2 = mix(h1 ^ 0x9e3779b97f4a7c15UL) | 1;
+}
+
+BloomFilter::BloomFilter(size_t num_bits, int num_hashes)
+    : bits(num_bits), hashes(num_hashes) {
+  if (num_bits == 0) {
+    throw std::invalid_argument("Bloom filter must have at least one bit");
+  }
+  check_hashes(num_hashes);
+
+  bytes.resize((num_bits + byte_bits - 1) / byte_bits);
+}
+
+BloomFilter BloomFilter::for_items(size_t items, double fpr) {
+  const size_t num_bits = optimal_bits(items, fpr);
+  return BloomFilter(num_bits, optimal_hashes(num_bits, items));
+}
+
+size_t BloomFilter::optimal_bits(size_t items, double fpr) {
+  check_fpr(fpr);
+
+  const double bits = -double(items) * std::log(fpr) / (M_LN2 * M_LN2);
+  return std::max<size_t>(1, std::ceil(bits));
+}
+
+int BloomFilter::optimal_hashes(size_t num_bits, size_t items) {
+  if (items == 0) {
+    return 1;
+  }
+
+  const double hashes = std::round(double(num_bits) / items * M_LN2);
+  return std::clamp<double>(hashes, 1, max_hashes);
+}
+
+double BloomFilter::false_positive_rate(size_t num_bits, int num_hashes,
+                                        size_t items) {
+  const double empty = std::exp(-double(num_hashes) * items / num_bits);
+  return std::pow(1 - empty, num_hashes);
+}
+
+void BloomFilter::insert(uint64_t key) {
+  uint64_t h1, h2;
+  hash(key, h1, h2);
+
+  for (int i = 0; i < hashes; i++, h1 += h2) {
+    const size_t pos = reduce(h1, bits);
+    bytes[pos / byte_bits] |= 1UL << (pos % byte_bits);
+  }
+}
+
+bool BloomFilter::contains(uint64_t key) const {
+  uint64_t h1, h2;
+  hash(key, h1, h2);
+
+  for (int i = 0; i < hashes; i++, h1 += h2) {
+    const size_t pos = reduce(h1, bits);
+    if (!(bytes[pos / byte_bits] >> (pos % byte_bits) & 1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void BloomFilter::insert_many(const uint64_t *keys, size_t size) {
+  uint64_t h1[batch], h2[batch];
+
+  for (size_t begin = 0; begin < size; begin += batch) {
+    const size_t n = std::min(batch, size - begin);
+
+    for (size_t j = 0; j < n; j++) {
+      hash(keys[begin + j], h1[j], h2[j]);
+
+      uint64_t h = h1[j];
+      for (int i = 0; i < hashes; i++, h += h2[j]) {
+        __builtin_prefetch(&bytes[reduce(h, bits) / byte_bits], 1);
+      }
+    }
+
+    for (size_t j = 0; j < n; j++) {
+      uint64_t h = h1[j];
+      for (int i = 0; i < hashes; i++, h += h2[j]) {
+        const size_t pos = reduce(h, bits);
+        bytes[pos / byte_bits] |= 1UL << (pos % byte_bits);
+      }
+    }
+  }
+}
+
+size_t BloomFilter::contains_many(const uint64_t *keys, size_t size,
+                                  bool *result) const {
+  uint64_t h1[batch], h2[batch];
+  size_t found = 0;
+
+  for (size_t begin = 0; begin < size; begin += batch) {
+    const size_t n = std::min(batch, size - begin);
+
+    for (size_t j = 0; j < n; j++) {
+      hash(keys[begin + j], h1[j], h2[j]);
+
+      uint64_t h = h1[j];
+      for (int i = 0; i < hashes; i++, h += h2[j]) {
+        __builtin_prefetch(&bytes[reduce(h, bits) / byte_bits]);
+      }
+    }
+
+    // All probes are made without branches, bytes are already in cache
+    for (size_t j = 0; j < n; j++) {
+      uint64_t h = h1[j];
+      byte_type hit = 1;
+
+      for (int i = 0; i < hashes; i++, h += h2[j]) {
+        const size_t pos = reduce(h, bits);
+        hit &= bytes[pos / byte_bits] >> (pos % byte_bits);
+      }
+
+      result[begin + j] = hit & 1;
+      found += hit & 1;
+    }
+  }
+
+  return found;
+}
+
+void BloomFilter::clear() { BitKernels::fill(bytes.data(), bytes.size(), 0); }
+
+BloomFilter &BloomFilter::operator|=(const BloomFilter &b) {
+  if (bits != b.bits || hashes != b.hashes) {
+    throw std::invalid_argument(
+        "Bloom filters must have the same size and number of hashes");
+  }
+
+  BitKernels::bit_or(bytes.data(), b.bytes.data(), bytes.size());
+  return *this;
+}
+
+size_t BloomFilter::count() const {
+  return BitKernels::count(bytes.data(), bytes.size());
+}
+
+double BloomFilter::estimated_false_positive_rate() const {
+  return std::pow(double(count()) / bits, hashes);
+}
+
+// BlockedBloomFilter
+
+size_t BlockedBloomFilter::locate(uint64_t key, byte_type *mask) const {
+  const uint64_t h = mix(key);
+  const uint64_t h2 = mix(h ^ 0x9e3779b97f4a7c15UL);
+
+  // Odd step visits different bits of the block
+  size_t pos = h2 % block_bits;
+  const size_t step = (h2 >> 32) | 1;
+
+  std::fill(mask, mask + block_bytes, 0);
+
+  for (int i = 0; i < hashes; i++, pos = (pos + step) % block_bits) {
+    mask[pos / byte_bits] |= 1UL << (pos % byte_bits);
+  }
+
+  return reduce(h, blocks);
+}
+
+BlockedBloomFilter::BlockedBloomFilter(size_t num_bits, int num_hashes)
+    : blocks((num_bits + block_bits - 1) / block_bits), hashes(num_hashes) {
+  if (num_bits == 0) {
+    throw std::invalid_argument("Bloom filter must have at least one bit");
+  }
+  check_hashes(num_hashes);
+
+  // Extra bytes let blocks start at a cache line wherever memory starts
+  bytes.resize(blocks * block_bytes + block_bytes - 1);
+
+  const size_t line = block_bytes * sizeof(byte_type);
+  const size_t addr = reinterpret_cast<uintptr_t>(bytes.data());
+  align = (line - addr % line) % line / sizeof(byte_type);
+}
+
+BlockedBloomFilter BlockedBloomFilter::for_items(size_t items, double fpr) {
+  // Start from the size of the classic filter and grow, until uneven load
+  // of blocks is paid for
+  size_t num_bits = BloomFilter::optimal_bits(items, fpr);
+  int num_hashes = BloomFilter::optimal_hashes(num_bits, items);
+
+  while (false_positive_rate(num_bits, num_hashes, items) > fpr) {
+    num_bits += num_bits / 16 + block_bits;
+    num_hashes = BloomFilter::optimal_hashes(num_bits, items);
+  }
+
+  return BlockedBloomFilter(num_bits, num_hashes);
+}
+
+double BlockedBloomFilter::false_positive_rate(size_t num_bits, int num_hashes,
+                                               size_t items) {
+  const size_t num_blocks = std::max<size_t>(
+      1, (num_bits + block_bits - 1) / block_bits);
+  const double load = double(items) / num_blocks;
+
+  if (load == 0) {
+    return 0;
+  }
+
+  // Terms further than 10 deviations from the mean are negligible
+  const double spread = 10 * std::sqrt(load) + 10;
+  const size_t first = std::max(0.0, load - spread);
+  const size_t last = load + spread;
+  double fpr = 0;
+
+  for (size_t i = first; i <= last; i++) {
+    const double p = std::exp(-load + i * std::log(load) - std::lgamma(i + 1));
+    fpr += p * BloomFilter::false_positive_rate(block_bits, num_hashes, i);
+  }
+
+  return std::min(fpr, 1.0);
+}
+
+void BlockedBloomFilter::insert(uint64_t key) {
+  byte_type mask[block_bytes];
+  byte_type *dst = block(locate(key, mask));
+
+  for (size_t i = 0; i < block_bytes; i++) {
+    dst[i] |= mask[i];
+  }
+}
+
+bool BlockedBloomFilter::contains(uint64_t key) const {
+  byte_type mask[block_bytes];
+  const byte_type *src = block(locate(key, mask));
+  byte_type missing = 0;
+
+  for (size_t i = 0; i < block_bytes; i++) {
+    missing |= mask[i] & ~src[i];
+  }
+
+  return missing == 0;
+}
+
+void BlockedBloomFilter::insert_many(const uint64_t *keys, size_t size) {
+  byte_type masks[batch][block_bytes];
+  byte_type *dst[batch];
+
+  for (size_t begin = 0; begin < size; begin += batch) {
+    const size_t n = std::min(batch, size - begin);
+
+    for (size_t j = 0; j < n; j++) {
+      dst[j] = block(locate(keys[begin + j], masks[j]));
+      __builtin_prefetch(dst[j], 1);
+    }
+
+    for (size_t j = 0; j < n; j++) {
+      for (size_t i = 0; i < block_bytes; i++) {
+        dst[j][i] |= masks[j][i];
+      }
+    }
+  }
+}
+
+size_t BlockedBloomFilter::contains_many(const uint64_t *keys, size_t size,
+                                         bool *result) const {
+  byte_type masks[batch][block_bytes];
+  const byte_type *src[batch];
+  size_t found = 0;
+
+  for (size_t begin = 0; begin < size; begin += batch) {
+    const size_t n = std::min(batch, size - begin);
+
+    for (size_t j = 0; j < n; j++) {
+      src[j] = block(locate(keys[begin + j], masks[j]));
+      __builtin_prefetch(src[j]);
+    }
+
+    for (size_t j = 0; j < n; j++) {
+      byte_type missing = 0;
+
+      for (size_t i = 0; i < block_bytes; i++) {
+        missing |= masks[j][i] & ~src[j][i];
+      }
+
+      result[begin + j] = missing == 0;
+      found += missing == 0;
+    }
+  }
+
+  return found;
+}
+
+void BlockedBloomFilter::clear() {
+  BitKernels::fill(block(0), blocks * block_bytes, 0);
+}
+
+BlockedBloomFilter &BlockedBloomFilter::operator|=(
+    const BlockedBloomFilter &b) {
+  if (blocks != b.blocks || hashes != b.hashes) {
+    throw std::invalid_argument(
+        "Bloom filters must have the same size and number of hashes");
+  }
+
+  BitKernels::bit_or(block(0), b.block(0), blocks * block_bytes);
+  return *this;
+}
+
+size_t BlockedBloomFilter::count() const {
+  return BitKernels::count(block(0), blocks * block_bytes);
+}
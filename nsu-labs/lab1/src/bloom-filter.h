@@ -0,0 +1,136 @@
+#ifndef BLOOM_FILTER
+#define BLOOM_FILTER
+
+#include "bit-span.h"
+#include "byte-storage.h"
+#include <cstddef>
+#include <cstdint>
+
+// Probabilistic set of 64-bit keys without false negatives
+// Keys are mixed inside, so they don't need to be hashed well. Bytes are
+// kept like in BitArray, so clear(), count() and |= run on BitKernels.
+// Batched operations hash a group of keys first and prefetch their bytes,
+// so memory latency of different keys overlaps.
+
+class BloomFilter {
+private:
+  ByteStorage bytes;
+  size_t bits;
+  int hashes;
+
+  // Two independent hashes, k'th probe is h1 + k * h2
+  static void hash(uint64_t key, uint64_t &h1, uint64_t &h2);
+
+public:
+  // Keys, which are hashed and prefetched at once by batched operations
+  static constexpr size_t batch = 16;
+
+  // Filter of 'num_bits' bits, which sets 'num_hashes' bits per key
+  BloomFilter(size_t num_bits, int num_hashes);
+
+  // Filter of optimal size for 'items' keys and false positive rate
+  static BloomFilter for_items(size_t items, double fpr);
+
+  // Bits needed for 'items' keys with false positive rate 'fpr'
+  static size_t optimal_bits(size_t items, double fpr);
+
+  // Number of hashes, which gives the lowest false positive rate
+  static int optimal_hashes(size_t num_bits, size_t items);
+
+  // Expected false positive rate after 'items' keys are inserted
+  static double false_positive_rate(size_t num_bits, int num_hashes,
+                                    size_t items);
+
+  void insert(uint64_t key);
+  bool contains(uint64_t key) const;
+
+  // Insert (look up) 'size' keys, result[i] tells, if keys[i] may be in
+  // the filter
+  // Return number of keys, which may be in the filter
+  void insert_many(const uint64_t *keys, size_t size);
+  size_t contains_many(const uint64_t *keys, size_t size, bool *result) const;
+
+  // Remove all keys
+  void clear();
+
+  // Add keys of filter with the same size and hashes
+  BloomFilter &operator|=(const BloomFilter &b);
+
+  size_t size() const { return bits; }
+  int num_hashes() const { return hashes; }
+
+  // Number of bits of value 1
+  size_t count() const;
+
+  // False positive rate, estimated by share of bits of value 1
+  double estimated_false_positive_rate() const;
+
+  // Bits of the filter
+  ConstBitSpan span() const { return ConstBitSpan(bytes.data(), 0, bits); }
+};
+
+// Bloom filter, which keeps all bits of a key in one cache line
+// Lookup takes one cache miss instead of one per hash, for the price of a
+// bit higher false positive rate. Bits of a key are set by a mask of the
+// whole block, which compiler turns into vector instructions.
+class BlockedBloomFilter {
+public:
+  static constexpr size_t block_bytes = 64 / sizeof(byte_type);
+  static constexpr size_t block_bits = 512;
+
+  static constexpr size_t batch = BloomFilter::batch;
+
+private:
+  ByteStorage bytes;
+  size_t blocks;
+  int hashes;
+
+  // Bytes before the first block, so blocks of a new filter start at cache
+  // lines (copies keep the layout, which is only a matter of speed)
+  size_t align;
+
+  byte_type *block(size_t i) { return bytes.data() + align + i * block_bytes; }
+  const byte_type *block(size_t i) const {
+    return bytes.data() + align + i * block_bytes;
+  }
+
+  // Block of the key and mask of its bits in the block
+  size_t locate(uint64_t key, byte_type *mask) const;
+
+public:
+  // Filter of at least 'num_bits' bits, rounded up to whole blocks
+  BlockedBloomFilter(size_t num_bits, int num_hashes);
+
+  // Filter of optimal size for 'items' keys and false positive rate
+  static BlockedBloomFilter for_items(size_t items, double fpr);
+
+  // Expected false positive rate after 'items' keys are inserted
+  // Keys are spread over blocks unevenly, so it is a sum over the Poisson
+  // distribution of keys per block
+  static double false_positive_rate(size_t num_bits, int num_hashes,
+                                    size_t items);
+
+  void insert(uint64_t key);
+  bool contains(uint64_t key) const;
+
+  // Same as in BloomFilter
+  void insert_many(const uint64_t *keys, size_t size);
+  size_t contains_many(const uint64_t *keys, size_t size, bool *result) const;
+
+  // Remove all keys
+  void clear();
+
+  // Add keys of filter with the same size and hashes
+  BlockedBloomFilter &operator|=(const BlockedBloomFilter &b);
+
+  size_t size() const { return blocks * block_bits; }
+  int num_hashes() const { return hashes; }
+
+  // Number of bits of value 1
+  size_t count() const;
+
+  // Bits of the filter
+  ConstBitSpan span() const { return ConstBitSpan(block(0), 0, size()); }
+};
+
+#endif
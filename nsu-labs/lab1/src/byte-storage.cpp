@@ -0,0 +1,158 @@
+#include "byte-storage.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Private
+
+void ByteStorage::reallocate(size_t new_cap) {
+  byte_type *new_ptr =
+      new_cap <= inline_bytes
+          ? local
+          : static_cast<byte_type *>(res->allocate(
+                new_cap * sizeof(byte_type), alignof(byte_type)));
+
+  if (new_ptr != ptr) {
+    std::memcpy(new_ptr, ptr, std::min(len, new_cap) * sizeof(byte_type));
+  }
+
+  if (new_ptr != ptr) {
+    deallocate();
+  }
+
+  ptr = new_ptr;
+  cap = std::max(new_cap, inline_bytes);
+}
+
+void ByteStorage::deallocate() {
+  if (!is_inline()) {
+    res->deallocate(ptr, cap * sizeof(byte_type), alignof(byte_type));
+  }
+}
+
+// Public
+
+ByteStorage::ByteStorage() : ByteStorage(std::pmr::get_default_resource()) {}
+
+ByteStorage::ByteStorage(std::pmr::memory_resource *resource)
+    : ptr(local), len(0), cap(inline_bytes), res(resource) {}
+
+ByteStorage::ByteStorage(size_t size, byte_type value,
+                         std::pmr::memory_resource *resource)
+    : ByteStorage(resource) {
+  assign(size, value);
+}
+
+ByteStorage::ByteStorage(const ByteStorage &other) : ByteStorage() {
+  *this = other;
+}
+
+ByteStorage::ByteStorage(const ByteStorage &other,
+                         std::pmr::memory_resource *resource)
+    : ByteStorage(resource) {
+  *this = other;
+}
+
+ByteStorage::ByteStorage(ByteStorage &&other) noexcept
+    : ByteStorage(other.res) {
+  swap(other);
+}
+
+ByteStorage::~ByteStorage() { deallocate(); }
+
+ByteStorage &ByteStorage::operator=(const ByteStorage &other) {
+  if (this == &other) {
+    return *this;
+  }
+
+  if (other.len > cap) {
+    len = 0;
+    reallocate(other.len);
+  }
+
+  std::memcpy(ptr, other.ptr, other.len * sizeof(byte_type));
+  len = other.len;
+
+  return *this;
+}
+
+ByteStorage &ByteStorage::operator=(ByteStorage &&other) {
+  if (this == &other) {
+    return *this;
+  }
+
+  // Bytes from another resource can't be adopted, so they are copied
+  if (!other.is_inline() && *res != *other.res) {
+    return *this = other;
+  }
+
+  ByteStorage tmp(std::move(other));
+  tmp.res = res;
+  swap(tmp);
+
+  return *this;
+}
+
+void ByteStorage::swap(ByteStorage &other) noexcept {
+  if (!is_inline() && !other.is_inline()) {
+    std::swap(ptr, other.ptr);
+  } else {
+    // Inline bytes can't be stolen, so swap goes through a copy of them
+    byte_type tmp[inline_bytes];
+    std::memcpy(tmp, local, sizeof(local));
+    std::memcpy(local, other.local, sizeof(local));
+    std::memcpy(other.local, tmp, sizeof(local));
+
+    byte_type *const this_ptr = is_inline() ? other.local : ptr;
+    ptr = other.is_inline() ? local : other.ptr;
+    other.ptr = this_ptr;
+  }
+
+  std::swap(len, other.len);
+  std::swap(cap, other.cap);
+  std::swap(res, other.res);
+}
+
+byte_type &ByteStorage::at(size_t i) {
+  if (i >= len) {
+    throw std::out_of_range("ByteStorage index is out of range");
+  }
+
+  return ptr[i];
+}
+
+const byte_type &ByteStorage::at(size_t i) const {
+  if (i >= len) {
+    throw std::out_of_range("ByteStorage index is out of range");
+  }
+
+  return ptr[i];
+}
+
+void ByteStorage::reserve(size_t size) {
+  if (size > cap) {
+    reallocate(size);
+  }
+}
+
+void ByteStorage::resize(size_t size) {
+  if (size > cap) {
+    reallocate(std::max(size, 2 * cap));
+  }
+
+  if (size > len) {
+    std::memset(ptr + len, 0, (size - len) * sizeof(byte_type));
+  }
+
+  len = size;
+}
+
+void ByteStorage::assign(size_t size, byte_type value) {
+  if (size > cap) {
+    len = 0;
+    reallocate(size);
+  }
+
+  BitKernels::fill(ptr, size, value);
+  len = size;
+}
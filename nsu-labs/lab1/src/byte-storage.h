@@ -0,0 +1,87 @@
+#ifndef BYTE_STORAGE
+#define BYTE_STORAGE
+
+#include "bit-kernels.h"
+#include <cstddef>
+#include <memory_resource>
+
+// Contiguous array of bytes with small buffer optimization
+// Up to 'inline_bytes' bytes are kept inside the object, larger arrays are
+// allocated from a memory resource (default resource, if none is given).
+// Like pmr containers, copies use the default resource, assignments keep
+// the resource of the target, moves and swaps take it with the bytes.
+class ByteStorage {
+public:
+  static constexpr size_t inline_bytes = 4;
+
+private:
+  byte_type *ptr;
+  size_t len;
+  size_t cap;
+  std::pmr::memory_resource *res;
+  byte_type local[inline_bytes] = {};
+
+  void deallocate();
+
+  // Move content to a buffer of 'new_cap' bytes
+  void reallocate(size_t new_cap);
+
+public:
+  ByteStorage();
+  explicit ByteStorage(std::pmr::memory_resource *resource);
+  explicit ByteStorage(size_t size, byte_type value = 0,
+                       std::pmr::memory_resource *resource =
+                           std::pmr::get_default_resource());
+  ByteStorage(const ByteStorage &other);
+  ByteStorage(const ByteStorage &other, std::pmr::memory_resource *resource);
+  ByteStorage(ByteStorage &&other) noexcept;
+  ~ByteStorage();
+
+  ByteStorage &operator=(const ByteStorage &other);
+  // Copies bytes, if resources are different
+  ByteStorage &operator=(ByteStorage &&other);
+
+  void swap(ByteStorage &other) noexcept;
+
+  // True, if bytes are kept inside the object
+  bool is_inline() const { return ptr == local; }
+
+  std::pmr::memory_resource *resource() const { return res; }
+
+  size_t size() const { return len; }
+  size_t capacity() const { return cap; }
+  bool empty() const { return len == 0; }
+
+  byte_type *data() { return ptr; }
+  const byte_type *data() const { return ptr; }
+
+  byte_type &operator[](size_t i) { return ptr[i]; }
+  const byte_type &operator[](size_t i) const { return ptr[i]; }
+
+  // Checked access, throws std::out_of_range
+  byte_type &at(size_t i);
+  const byte_type &at(size_t i) const;
+
+  byte_type &back() { return ptr[len - 1]; }
+  const byte_type &back() const { return ptr[len - 1]; }
+
+  byte_type *begin() { return ptr; }
+  byte_type *end() { return ptr + len; }
+  const byte_type *begin() const { return ptr; }
+  const byte_type *end() const { return ptr + len; }
+
+  // Make room for 'size' bytes without reallocation
+  void reserve(size_t size);
+
+  // Resize array, new bytes are initialized with 0
+  // Capacity grows at least twice, so repeated growth is amortized
+  void resize(size_t size);
+
+  // Resize array and fill all bytes with 'value'
+  void assign(size_t size, byte_type value);
+
+  // Remove all bytes, memory is kept
+  void clear() { len = 0; }
+};
+
+#endif
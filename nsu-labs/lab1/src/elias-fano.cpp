@@ -0,0 +1,101 @@
+#include "elias-fano.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Low bits, which minimize size of 'size' values up to 'max'
+int choose_low_bits(size_t size, uint64_t max) {
+  if (size == 0 || max / size == 0) {
+    return 0;
+  }
+  return 63 - __builtin_clzl(max / size);
+}
+
+} // namespace
+
+EliasFano::EliasFano() : low(0, 1), high(1), len(0), l(0), last(0) {}
+
+EliasFano::EliasFano(const uint64_t *values, size_t size)
+    : low(0, 1), len(size), l(0), last(size ? values[size - 1] : 0) {
+  for (size_t i = 1; i < size; i++) {
+    if (values[i] < values[i - 1]) {
+      throw std::invalid_argument("Elias-Fano values must not decrease");
+    }
+  }
+
+  l = choose_low_bits(size, last);
+
+  if (l > 0) {
+    low = PackedIntArray<>(size, l);
+  }
+
+  // Every value sets one bit, and high parts of values add at most
+  // last >> l zeros, the last bit stays 0 for end of the last bucket
+  high = BitArray((last >> l) + size + 1);
+
+  const uint64_t mask = l ? (1UL << l) - 1 : 0;
+
+  for (size_t i = 0; i < size; i++) {
+    if (l > 0) {
+      low.set(i, values[i] & mask);
+    }
+    high.set((values[i] >> l) + i);
+  }
+
+  // Directory is built now, not by the first query
+  high.rank1(0);
+}
+
+EliasFano::EliasFano(const std::vector<uint64_t> &values)
+    : EliasFano(values.data(), values.size()) {}
+
+uint64_t EliasFano::access(size_t i) const {
+  if (i >= len) {
+    throw std::out_of_range("Unable to access: i is out of range");
+  }
+
+  return value(i, high.select1(i));
+}
+
+uint64_t EliasFano::back() const {
+  if (len == 0) {
+    throw std::out_of_range("Unable to get back: sequence is empty");
+  }
+
+  return last;
+}
+
+EliasFano::ConstIterator EliasFano::next_geq(uint64_t x) const {
+  if (len == 0 || x > last) {
+    return end();
+  }
+
+  // Bucket of x starts after its h'th zero, values of lower buckets are
+  // before it
+  const size_t h = x >> l;
+  const size_t from = h == 0 ? 0 : high.select0(h - 1) + 1;
+  ConstIterator it(this, from - h, from);
+
+  // Only values of the bucket of x may be less than x
+  while (*it < x) {
+    ++it;
+  }
+
+  return it;
+}
+
+std::vector<uint64_t> EliasFano::to_vector() const {
+  return std::vector<uint64_t>(begin(), end());
+}
+
+size_t EliasFano::size_in_bytes() const {
+  return (l ? low.memory_bytes() : 0) + high.byte_count() * byte_size +
+         high.rank_directory_bytes();
+}
+
+bool operator==(const EliasFano &a, const EliasFano &b) {
+  return a.len == b.len && std::equal(a.begin(), a.end(), b.begin());
+}
+
+bool operator!=(const EliasFano &a, const EliasFano &b) { return !(a == b); }
@@ -0,0 +1,140 @@
+#ifndef ELIAS_FANO
+#define ELIAS_FANO
+
+#include "bit-array.h"
+#include "packed-int-array.h"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+// Non-decreasing sequence of integers in Elias-Fano encoding
+// Every value is split into 'l' low bits, kept in a packed array, and high
+// bits, kept in unary: i'th value sets bit (value >> l) + i of a bit array.
+// With l = floor(log2(max / size)) a value takes 2 to 3 + l bits. Values are
+// found by select of ones of the high bits, and buckets of high bits by
+// select of zeros, through the rank/select directory of BitArray.
+class EliasFano {
+private:
+  PackedIntArray<> low;
+  BitArray high;
+  size_t len;
+  int l;
+  uint64_t last;
+
+  uint64_t value(size_t i, size_t pos) const {
+    return uint64_t(pos - i) << l | (l ? low[i] : 0);
+  }
+
+public:
+  // Sequential decoder of values, which walks ones of the high bits by
+  // whole bytes
+  class ConstIterator {
+  private:
+    const EliasFano *ef;
+    size_t i;
+    // Byte of high bits and its ones after the current one
+    size_t byte_pos;
+    byte_type rest;
+    uint64_t val;
+
+    friend class EliasFano;
+
+    // Iterator at i'th value, whose high bit is at 'from' or after it
+    ConstIterator(const EliasFano *ef, size_t i, size_t from)
+        : ef(ef), i(i), byte_pos(from / BitArray::byte_bits), rest(0),
+          val(0) {
+      if (i < ef->len) {
+        rest = ef->high.data()[byte_pos] >> (from % BitArray::byte_bits)
+               << (from % BitArray::byte_bits);
+        advance();
+      }
+    }
+
+    void advance() {
+      const byte_type *bytes = ef->high.data();
+
+      while (!rest) {
+        rest = bytes[++byte_pos];
+      }
+
+      const size_t pos = byte_pos * BitArray::byte_bits + __builtin_ctzl(rest);
+      rest &= rest - 1;
+      val = ef->value(i, pos);
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = uint64_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const uint64_t *;
+    using reference = const uint64_t &;
+
+    ConstIterator() : ef(nullptr), i(0), byte_pos(0), rest(0), val(0) {}
+
+    // Index of the value in the sequence
+    size_t index() const { return i; }
+
+    const uint64_t &operator*() const { return val; }
+    const uint64_t *operator->() const { return &val; }
+
+    ConstIterator &operator++() {
+      if (++i < ef->len) {
+        advance();
+      }
+      return *this;
+    }
+
+    ConstIterator operator++(int) {
+      ConstIterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    friend bool operator==(const ConstIterator &a, const ConstIterator &b) {
+      return a.i == b.i;
+    }
+    friend bool operator!=(const ConstIterator &a, const ConstIterator &b) {
+      return a.i != b.i;
+    }
+  };
+
+  using const_iterator = ConstIterator;
+
+  // Empty sequence
+  EliasFano();
+
+  // Encode 'size' values, throws std::invalid_argument if they decrease
+  EliasFano(const uint64_t *values, size_t size);
+  explicit EliasFano(const std::vector<uint64_t> &values);
+
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+
+  // Number of low bits of every value
+  int low_bits() const { return l; }
+
+  // Return i'th value, throws std::out_of_range
+  uint64_t access(size_t i) const;
+  uint64_t operator[](size_t i) const { return access(i); }
+
+  // The last value, throws std::out_of_range if sequence is empty
+  uint64_t back() const;
+
+  // First value, which is not less than x, or end()
+  ConstIterator next_geq(uint64_t x) const;
+
+  ConstIterator begin() const { return ConstIterator(this, 0, 0); }
+  ConstIterator end() const { return ConstIterator(this, len, 0); }
+
+  // Decode all values
+  std::vector<uint64_t> to_vector() const;
+
+  // Memory of low and high bits and of the rank/select directory
+  size_t size_in_bytes() const;
+
+  friend bool operator==(const EliasFano &a, const EliasFano &b);
+  friend bool operator!=(const EliasFano &a, const EliasFano &b);
+};
+
+#endif
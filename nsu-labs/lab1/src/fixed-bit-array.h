@@ -0,0 +1,345 @@
+#ifndef FIXED_BIT_ARRAY
+#define FIXED_BIT_ARRAY
+
+#include "bit-array.h"
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Bit array of N bits, known at compile time
+// Words are kept inside the object, all operations are constexpr and there
+// are no size checks in bitwise operators. Loops over words are unrolled at
+// compile time for small arrays.
+// Converts to BitArray like any bit expression, and back by constructor.
+template <size_t N, class Word = uint64_t>
+class FixedBitArray : public BitExpr<FixedBitArray<N, Word>> {
+  static_assert(std::is_unsigned<Word>::value, "Word must be unsigned");
+
+public:
+  static constexpr int word_bits = sizeof(Word) * CHAR_BIT;
+  static constexpr size_t words = (N + word_bits - 1) / word_bits;
+
+  // Arrays of at most so many words have their loops unrolled
+  static constexpr size_t unroll_words = 8;
+
+  static constexpr size_t npos = BitArray::npos;
+
+  // Words are read in place of bytes of the array
+  static constexpr bool elementwise = true;
+
+private:
+  static constexpr int byte_bits = sizeof(byte_type) * CHAR_BIT;
+  static constexpr int words_per_byte =
+      word_bits < byte_bits ? byte_bits / word_bits : 1;
+
+  // Unused bits of the last word are 0
+  static constexpr Word last_mask =
+      N % word_bits ? Word(Word(1) << N % word_bits) - 1 : Word(~Word(0));
+
+  Word data[words > 0 ? words : 1];
+
+  template <class F, size_t... I>
+  static constexpr void unrolled(F &f, std::index_sequence<I...>) {
+    (f(I), ...);
+  }
+
+  // Call f(i) for every word
+  template <class F> static constexpr void each_word(F f) {
+    if constexpr (words <= unroll_words) {
+      unrolled(f, std::make_index_sequence<words>());
+    } else {
+      for (size_t i = 0; i < words; i++) {
+        f(i);
+      }
+    }
+  }
+
+  static constexpr int popcount(Word word) {
+    return __builtin_popcountll(word);
+  }
+
+  static constexpr int ctz(Word word) { return __builtin_ctzll(word); }
+
+  constexpr void trim() {
+    if constexpr (words > 0) {
+      data[words - 1] &= last_mask;
+    }
+  }
+
+  static constexpr void check(size_t n, const char *msg) {
+    if (n >= N) {
+      throw std::out_of_range(msg);
+    }
+  }
+
+  constexpr size_t find_from(size_t from, Word flip) const {
+    for (size_t i = from / word_bits; i < words; i++) {
+      Word word = data[i] ^ flip;
+
+      if (i == from / word_bits) {
+        word &= Word(~Word(0)) << from % word_bits;
+      }
+      if (i == words - 1) {
+        word &= last_mask;
+      }
+      if (word) {
+        return i * word_bits + ctz(word);
+      }
+    }
+
+    return npos;
+  }
+
+public:
+  constexpr FixedBitArray() : data{} {}
+
+  // First bits may be initialized with parameter 'value'
+  constexpr explicit FixedBitArray(unsigned long long value) : data{} {
+    for (size_t i = 0; i < words && i * word_bits < 64; i++) {
+      data[i] = Word(value >> i * word_bits);
+    }
+    trim();
+  }
+
+  // Copy bit array of the same size, throws std::invalid_argument
+  explicit FixedBitArray(const BitArray &b) : data{} {
+    if (b.size() != N) {
+      throw std::invalid_argument("BitArray must have the same size");
+    }
+
+    for (size_t i = 0; i < words; i++) {
+      data[i] = Word(b.byte(i / words_per_byte) >>
+                     (i % words_per_byte) * word_bits);
+    }
+  }
+
+  // Copy bits into a bit array, same as BitArray(*this)
+  BitArray to_bit_array() const { return BitArray(*this); }
+
+  static constexpr size_t size() { return N; }
+  static constexpr bool empty() { return N == 0; }
+
+  constexpr Word word(size_t i) const { return data[i]; }
+
+  // Return i'th byte of bit array, 0 if it is out of range
+  constexpr byte_type byte(size_t i) const {
+    if constexpr (word_bits >= byte_bits) {
+      return i < words ? data[i] : 0;
+    } else {
+      byte_type byte = 0;
+
+      for (int j = 0; j < words_per_byte; j++) {
+        const size_t k = i * words_per_byte + j;
+        if (k < words) {
+          byte |= byte_type(data[k]) << j * word_bits;
+        }
+      }
+
+      return byte;
+    }
+  }
+
+  // Set n'th bit to 'value'
+  constexpr FixedBitArray &set(size_t n, bool val = true) {
+    check(n, "Unable to set: n is out of range");
+
+    const Word mask = Word(1) << n % word_bits;
+    Word &w = data[n / word_bits];
+    w = val ? w | mask : w & ~mask;
+
+    return *this;
+  }
+
+  // Fill array with 1's
+  constexpr FixedBitArray &set() {
+    each_word([this](size_t i) { data[i] = ~Word(0); });
+    trim();
+    return *this;
+  }
+
+  // Set n'th bit to 0
+  constexpr FixedBitArray &reset(size_t n) { return set(n, false); }
+
+  // Fill array with 0's
+  constexpr FixedBitArray &reset() {
+    each_word([this](size_t i) { data[i] = 0; });
+    return *this;
+  }
+
+  // Invert all bits
+  constexpr FixedBitArray &flip() {
+    each_word([this](size_t i) { data[i] = ~data[i]; });
+    trim();
+    return *this;
+  }
+
+  // Return i'th bit value
+  constexpr bool get(size_t i) const {
+    check(i, "Unable to get: i is out of range");
+    return (*this)[i];
+  }
+
+  // Unchecked access
+  constexpr bool operator[](size_t i) const {
+    return (data[i / word_bits] >> i % word_bits) & 1;
+  }
+
+  // Count bits of value 1
+  constexpr size_t count() const {
+    size_t ones = 0;
+    each_word([&](size_t i) { ones += popcount(data[i]); });
+    return ones;
+  }
+
+  // True, if at least one bit of value 1
+  constexpr bool any() const {
+    Word acc = 0;
+    each_word([&](size_t i) { acc |= data[i]; });
+    return acc != 0;
+  }
+
+  // True, if all bits are 0's
+  constexpr bool none() const { return !any(); }
+
+  // True, if all bits are 1's
+  constexpr bool all() const { return count() == N; }
+
+  // Position of the first bit of value 1 (0), or npos
+  constexpr size_t find_first() const { return find_from(0, 0); }
+  constexpr size_t find_first_zero() const {
+    return find_from(0, ~Word(0));
+  }
+
+  // Position of the first bit of value 1 (0) after i'th bit, or npos
+  constexpr size_t find_next(size_t i) const {
+    return i + 1 < N ? find_from(i + 1, 0) : npos;
+  }
+  constexpr size_t find_next_zero(size_t i) const {
+    return i + 1 < N ? find_from(i + 1, ~Word(0)) : npos;
+  }
+
+  // Call f(i) for every bit of value 1 in ascending order
+  template <class F> constexpr void for_each_set_bit(F f) const {
+    for (size_t i = 0; i < words; i++) {
+      for (Word word = data[i]; word; word &= word - 1) {
+        f(i * word_bits + ctz(word));
+      }
+    }
+  }
+
+  constexpr FixedBitArray &operator&=(const FixedBitArray &b) {
+    each_word([&](size_t i) { data[i] &= b.data[i]; });
+    return *this;
+  }
+
+  constexpr FixedBitArray &operator|=(const FixedBitArray &b) {
+    each_word([&](size_t i) { data[i] |= b.data[i]; });
+    return *this;
+  }
+
+  constexpr FixedBitArray &operator^=(const FixedBitArray &b) {
+    each_word([&](size_t i) { data[i] ^= b.data[i]; });
+    return *this;
+  }
+
+  // Bitwise shifting inside of N bits, filling with 0's
+  constexpr FixedBitArray &operator<<=(size_t n) {
+    if (n >= N) {
+      return reset();
+    }
+
+    const size_t word_shift = n / word_bits;
+    const int bit_shift = n % word_bits;
+
+    for (size_t i = words; i-- > 0;) {
+      Word word = i >= word_shift ? data[i - word_shift] : 0;
+
+      if (bit_shift > 0) {
+        word <<= bit_shift;
+        if (i > word_shift) {
+          word |= data[i - word_shift - 1] >> (word_bits - bit_shift);
+        }
+      }
+
+      data[i] = word;
+    }
+
+    trim();
+    return *this;
+  }
+
+  constexpr FixedBitArray &operator>>=(size_t n) {
+    if (n >= N) {
+      return reset();
+    }
+
+    const size_t word_shift = n / word_bits;
+    const int bit_shift = n % word_bits;
+
+    for (size_t i = 0; i < words; i++) {
+      const size_t j = i + word_shift;
+      Word word = j < words ? data[j] : 0;
+
+      if (bit_shift > 0) {
+        word >>= bit_shift;
+        if (j + 1 < words) {
+          word |= data[j + 1] << (word_bits - bit_shift);
+        }
+      }
+
+      data[i] = word;
+    }
+
+    return *this;
+  }
+
+  constexpr FixedBitArray operator~() const {
+    return FixedBitArray(*this).flip();
+  }
+
+  constexpr FixedBitArray operator<<(size_t n) const {
+    return FixedBitArray(*this) <<= n;
+  }
+
+  constexpr FixedBitArray operator>>(size_t n) const {
+    return FixedBitArray(*this) >>= n;
+  }
+
+  friend constexpr FixedBitArray operator&(FixedBitArray a,
+                                           const FixedBitArray &b) {
+    return a &= b;
+  }
+
+  friend constexpr FixedBitArray operator|(FixedBitArray a,
+                                           const FixedBitArray &b) {
+    return a |= b;
+  }
+
+  friend constexpr FixedBitArray operator^(FixedBitArray a,
+                                           const FixedBitArray &b) {
+    return a ^= b;
+  }
+
+  friend constexpr bool operator==(const FixedBitArray &a,
+                                   const FixedBitArray &b) {
+    bool equal = true;
+    each_word([&](size_t i) { equal &= a.data[i] == b.data[i]; });
+    return equal;
+  }
+
+  friend constexpr bool operator!=(const FixedBitArray &a,
+                                   const FixedBitArray &b) {
+    return !(a == b);
+  }
+};
+
+// Fixed arrays are used in expressions by reference, like bit arrays
+template <size_t N, class Word> struct BitExprTraits<FixedBitArray<N, Word>> {
+  using store = const FixedBitArray<N, Word> &;
+  static constexpr bool elementwise = true;
+};
+
+#endif
@@ -0,0 +1,435 @@
+#include "mapped-bit-array.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+// Private
+
+size_t MappedBitArray::to_bytes(size_t bits) {
+  return bits / BitArray::byte_bits + (bits % BitArray::byte_bits ? 1 : 0);
+}
+
+void *MappedBitArray::map_file(size_t size) const {
+  const int prot = writable() ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *ptr = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+
+  if (ptr == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to map bit array file");
+  }
+
+  return ptr;
+}
+
+void MappedBitArray::remap(size_t size) {
+  void *ptr = map_file(size);
+  unmap();
+
+  map = ptr;
+  map_size = size;
+  bytes = reinterpret_cast<byte_type *>(static_cast<Header *>(map) + 1);
+}
+
+void MappedBitArray::unmap() {
+  if (map != nullptr) {
+    munmap(map, map_size);
+  }
+
+  map = nullptr;
+  map_size = 0;
+  bytes = nullptr;
+}
+
+void MappedBitArray::check_writable(const char *msg) const {
+  if (!writable()) {
+    throw std::logic_error(msg);
+  }
+}
+
+void MappedBitArray::check_size(size_t size, const char *msg) const {
+  if (bits != size) {
+    throw std::invalid_argument(msg);
+  }
+}
+
+void MappedBitArray::check_range(size_t pos, size_t len,
+                                 const char *msg) const {
+  if (pos > bits || len > bits - pos) {
+    throw std::out_of_range(msg);
+  }
+}
+
+void MappedBitArray::trim() {
+  const int trail = bits % BitArray::byte_bits;
+
+  if (trail > 0) {
+    bytes[byte_count() - 1] &= (1UL << trail) - 1;
+  }
+}
+
+size_t MappedBitArray::find_from(size_t from, byte_type flip) const {
+  if (from >= bits) {
+    return npos;
+  }
+
+  const size_t size = byte_count();
+  size_t byte_pos = from / BitArray::byte_bits;
+
+  // Drop bits before 'from' in the first byte
+  byte_type byte =
+      (bytes[byte_pos] ^ flip) & (~0UL << (from % BitArray::byte_bits));
+
+  while (!byte && ++byte_pos < size) {
+    byte = bytes[byte_pos] ^ flip;
+  }
+
+  if (!byte) {
+    return npos;
+  }
+
+  const size_t pos = byte_pos * BitArray::byte_bits + __builtin_ctzl(byte);
+  return pos < bits ? pos : npos;
+}
+
+// Public
+
+MappedBitArray::MappedBitArray(const std::string &path, Mode mode)
+    : fd(-1), mode(mode), map(nullptr), map_size(0), bytes(nullptr),
+      bits(0) {
+  const int flags = writable() ? O_RDWR | O_CREAT : O_RDONLY;
+
+  fd = open(path.c_str(), flags, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to open bit array file " + path);
+  }
+
+  try {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "Unable to stat bit array file " + path);
+    }
+
+    size_t size = st.st_size;
+
+    // New file, write an empty array
+    if (size == 0 && writable()) {
+      size = sizeof(Header);
+
+      if (ftruncate(fd, size) < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to grow bit array file " + path);
+      }
+
+      remap(size);
+      *header() = {magic, 0};
+    } else if (size >= sizeof(Header)) {
+      remap(size);
+    }
+
+    if (map == nullptr || header()->magic != magic) {
+      throw std::runtime_error("Not a bit array file " + path);
+    }
+
+    bits = header()->bits;
+
+    if (bits > BitArray::max_size() ||
+        (size - sizeof(Header)) / sizeof(byte_type) < byte_count()) {
+      throw std::runtime_error("Bit array file is truncated " + path);
+    }
+
+    // count() and find*() rely on zero bits after the last one
+    const int trail = bits % BitArray::byte_bits;
+    if (trail > 0 && bytes[byte_count() - 1] >> trail) {
+      throw std::runtime_error("Bit array file has bits past its size " +
+                               path);
+    }
+  } catch (...) {
+    unmap();
+    close(fd);
+    throw;
+  }
+}
+
+MappedBitArray::MappedBitArray(MappedBitArray &&b) noexcept
+    : fd(b.fd), mode(b.mode), map(b.map), map_size(b.map_size),
+      bytes(b.bytes), bits(b.bits) {
+  b.fd = -1;
+  b.map = nullptr;
+  b.map_size = 0;
+  b.bytes = nullptr;
+  b.bits = 0;
+}
+
+MappedBitArray::~MappedBitArray() {
+  unmap();
+
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+MappedBitArray &MappedBitArray::operator=(MappedBitArray &&b) noexcept {
+  if (this != &b) {
+    MappedBitArray tmp(std::move(b));
+    swap(tmp);
+  }
+
+  return *this;
+}
+
+void MappedBitArray::swap(MappedBitArray &b) noexcept {
+  std::swap(fd, b.fd);
+  std::swap(mode, b.mode);
+  std::swap(map, b.map);
+  std::swap(map_size, b.map_size);
+  std::swap(bytes, b.bytes);
+  std::swap(bits, b.bits);
+}
+
+void MappedBitArray::flush() {
+  if (!writable() || map == nullptr) {
+    return;
+  }
+
+  if (msync(map, map_size, MS_SYNC) < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to flush bit array file");
+  }
+}
+
+void MappedBitArray::resize(size_t num_bits, bool value) {
+  check_writable("Unable to resize: bit array is read-only");
+
+  if (num_bits > BitArray::max_size()) {
+    throw std::out_of_range("Unable to resize: num_bits is too large");
+  }
+
+  const size_t old_bits = bits;
+  const size_t old_count = byte_count();
+  const size_t new_count = to_bytes(num_bits);
+
+  if (new_count != old_count) {
+    const size_t size = sizeof(Header) + new_count * sizeof(byte_type);
+
+    // New size is mapped first, so a failure keeps the array untouched.
+    // File grows with zeros, so new bytes don't need to be cleared
+    void *ptr = map_file(size);
+    if (ftruncate(fd, size) < 0) {
+      const int err = errno;
+      munmap(ptr, size);
+      throw std::system_error(err, std::generic_category(),
+                              "Unable to resize bit array file");
+    }
+
+    unmap();
+    map = ptr;
+    map_size = size;
+    bytes = reinterpret_cast<byte_type *>(header() + 1);
+  }
+
+  bits = num_bits;
+  header()->bits = bits;
+
+  // Shrinking keeps the tail invariant
+  if (num_bits < old_bits && new_count > 0) {
+    trim();
+  }
+
+  if (num_bits <= old_bits || !value) {
+    return;
+  }
+
+  const int trail = old_bits % BitArray::byte_bits;
+  if (trail > 0) {
+    bytes[old_count - 1] |= ~0UL << trail;
+  }
+
+  BitKernels::fill(bytes + old_count, new_count - old_count, ~0UL);
+  trim();
+}
+
+MappedBitArray &MappedBitArray::assign(const BitArray &b) {
+  resize(b.size());
+  std::memcpy(bytes, b.data(), byte_count() * sizeof(byte_type));
+
+  return *this;
+}
+
+ConstBitSpan MappedBitArray::span(size_t pos, size_t len) const {
+  return ConstBitSpan(*this).subspan(pos, len);
+}
+
+BitSpan MappedBitArray::span(size_t pos, size_t len) {
+  check_writable("Unable to make writable span: bit array is read-only");
+  return BitSpan(bytes, 0, bits).subspan(pos, len);
+}
+
+BitArray MappedBitArray::to_bit_array() const { return BitArray(*this); }
+
+MappedBitArray &MappedBitArray::set(size_t n, bool val) {
+  check_writable("Unable to set: bit array is read-only");
+
+  if (n >= bits) {
+    throw std::out_of_range("Unable to set: n is out of range");
+  }
+
+  byte_type &byte = bytes[n / BitArray::byte_bits];
+  const byte_type mask = 1UL << (n % BitArray::byte_bits);
+
+  byte = val ? byte | mask : byte & ~mask;
+
+  return *this;
+}
+
+MappedBitArray &MappedBitArray::set() {
+  check_writable("Unable to set: bit array is read-only");
+
+  BitKernels::fill(bytes, byte_count(), ~0UL);
+  if (bits > 0) {
+    trim();
+  }
+
+  return *this;
+}
+
+MappedBitArray &MappedBitArray::reset(size_t n) { return set(n, false); }
+
+MappedBitArray &MappedBitArray::reset() {
+  check_writable("Unable to reset: bit array is read-only");
+
+  BitKernels::fill(bytes, byte_count(), 0);
+
+  return *this;
+}
+
+MappedBitArray &MappedBitArray::set_range(size_t pos, size_t len, bool val) {
+  check_writable("Unable to set range: bit array is read-only");
+  check_range(pos, len, "Unable to set range: range is out of array");
+
+  if (val) {
+    span(pos, len).set();
+  } else {
+    span(pos, len).reset();
+  }
+
+  return *this;
+}
+
+MappedBitArray &MappedBitArray::reset_range(size_t pos, size_t len) {
+  return set_range(pos, len, false);
+}
+
+MappedBitArray &MappedBitArray::flip_range(size_t pos, size_t len) {
+  check_writable("Unable to flip range: bit array is read-only");
+  check_range(pos, len, "Unable to flip range: range is out of array");
+
+  span(pos, len).flip();
+
+  return *this;
+}
+
+size_t MappedBitArray::count_range(size_t pos, size_t len) const {
+  check_range(pos, len, "Unable to count range: range is out of array");
+
+  return span(pos, len).count();
+}
+
+MappedBitArray &MappedBitArray::operator&=(const BitArray &b) {
+  check_writable("Unable to &=: bit array is read-only");
+  check_size(b.size(), "BitArrays must have the same size for &= operator");
+
+  BitKernels::bit_and(bytes, b.data(), byte_count());
+
+  return *this;
+}
+
+MappedBitArray &MappedBitArray::operator|=(const BitArray &b) {
+  check_writable("Unable to |=: bit array is read-only");
+  check_size(b.size(), "BitArrays must have the same size for |= operator");
+
+  BitKernels::bit_or(bytes, b.data(), byte_count());
+
+  return *this;
+}
+
+MappedBitArray &MappedBitArray::operator^=(const BitArray &b) {
+  check_writable("Unable to ^=: bit array is read-only");
+  check_size(b.size(), "BitArrays must have the same size for ^= operator");
+
+  BitKernels::bit_xor(bytes, b.data(), byte_count());
+
+  return *this;
+}
+
+bool MappedBitArray::any() const {
+  return BitKernels::any(bytes, byte_count());
+}
+
+bool MappedBitArray::none() const { return !any(); }
+
+size_t MappedBitArray::count() const {
+  return BitKernels::count(bytes, byte_count());
+}
+
+bool MappedBitArray::get(size_t i) const {
+  if (i >= bits) {
+    throw std::out_of_range("Unable to get: i is out of range");
+  }
+
+  return (bytes[i / BitArray::byte_bits] >> (i % BitArray::byte_bits)) & 1UL;
+}
+
+bool MappedBitArray::operator[](size_t i) const { return get(i); }
+
+size_t MappedBitArray::find_first() const { return find_from(0, 0); }
+
+size_t MappedBitArray::find_first_zero() const { return find_from(0, ~0UL); }
+
+size_t MappedBitArray::find_last() const { return span().find_last(); }
+
+size_t MappedBitArray::find_last_zero() const {
+  return span().find_last_zero();
+}
+
+size_t MappedBitArray::find_next(size_t i) const {
+  if (i >= bits) {
+    throw std::out_of_range("Unable to find next: i is out of range");
+  }
+
+  return find_from(i + 1, 0);
+}
+
+size_t MappedBitArray::find_next_zero(size_t i) const {
+  if (i >= bits) {
+    throw std::out_of_range("Unable to find next zero: i is out of range");
+  }
+
+  return find_from(i + 1, ~0UL);
+}
+
+std::string MappedBitArray::to_string() const {
+  std::string str(bits, '0');
+
+  for_each_set_bit([&](size_t i) { str[bits - 1 - i] = '1'; });
+
+  return str;
+}
+
+// Functions
+
+bool operator==(const MappedBitArray &b1, const BitArray &b2) {
+  return b1.size() == b2.size() &&
+         BitKernels::mismatch(b1.data(), b2.data(), b2.byte_count()) ==
+             b2.byte_count();
+}
+
+bool operator!=(const MappedBitArray &b1, const BitArray &b2) {
+  return !(b1 == b2);
+}
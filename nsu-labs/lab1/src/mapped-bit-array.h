@@ -0,0 +1,177 @@
+#ifndef MAPPED_BIT_ARRAY
+#define MAPPED_BIT_ARRAY
+
+#include "bit-array.h"
+#include <string>
+
+// Bit array, which bytes are kept in a memory-mapped file
+// Opening is instant, pages are loaded on access and shared with other
+// processes through the page cache. File starts with a header of magic and
+// size in bits, bytes follow in native byte order.
+// Queries of views and range operations are forwarded to spans of the
+// mapped bytes. There is no rank/select directory, so rank and select, as
+// well as assignment of expressions, go through to_bit_array() and
+// assign(). The array may be an operand of BitArray expressions.
+class MappedBitArray : public BitExpr<MappedBitArray> {
+public:
+  enum class Mode { read_only, read_write };
+
+  static constexpr size_t npos = BitArray::npos;
+
+private:
+  struct Header {
+    uint64_t magic;
+    uint64_t bits;
+  };
+
+  static constexpr uint64_t magic = 0x5941525241544942; // "BITARRAY"
+
+  int fd;
+  Mode mode;
+  void *map;
+  size_t map_size;
+  byte_type *bytes;
+  size_t bits;
+
+  static size_t to_bytes(size_t bits);
+
+  Header *header() const { return static_cast<Header *>(map); }
+  size_t byte_count() const { return to_bytes(bits); }
+
+  // Map 'size' bytes of the file, throws std::system_error
+  void *map_file(size_t size) const;
+
+  // Map 'size' bytes of the file, old mapping is dropped on success
+  void remap(size_t size);
+  void unmap();
+
+  void check_writable(const char *msg) const;
+  void check_size(size_t size, const char *msg) const;
+  void check_range(size_t pos, size_t len, const char *msg) const;
+
+  // Zero unused bits of the last byte
+  void trim();
+
+  size_t find_from(size_t from, byte_type flip) const;
+
+public:
+  // Open file, read-write mode creates it, if it doesn't exist
+  // Throws std::system_error if file can't be opened or mapped, and
+  // std::runtime_error if it isn't a bit array file
+  explicit MappedBitArray(const std::string &path,
+                          Mode mode = Mode::read_only);
+
+  MappedBitArray(const MappedBitArray &) = delete;
+  MappedBitArray(MappedBitArray &&b) noexcept;
+  ~MappedBitArray();
+
+  MappedBitArray &operator=(const MappedBitArray &) = delete;
+  MappedBitArray &operator=(MappedBitArray &&b) noexcept;
+
+  void swap(MappedBitArray &b) noexcept;
+
+  // Write changed pages to the file and wait for completion
+  void flush();
+
+  bool writable() const { return mode == Mode::read_write; }
+
+  // Resize array through ftruncate and remap
+  // If array expands, new elements are initialized with 'value'
+  // Throws std::system_error, then the array is unchanged
+  void resize(size_t num_bits, bool value = false);
+
+  // Replace content with bits of 'b'
+  MappedBitArray &assign(const BitArray &b);
+
+  // Copy bits into memory, same as BitArray(*this)
+  BitArray to_bit_array() const;
+
+  // Set n'th bit to 'value'
+  MappedBitArray &set(size_t n, bool val = true);
+
+  // Fill array with 1's
+  MappedBitArray &set();
+
+  // Set n'th bit to 0
+  MappedBitArray &reset(size_t n);
+
+  // Fill array with 0's
+  MappedBitArray &reset();
+
+  // Set bits [pos, pos + len) to 'value' (0, invert them)
+  // Throws std::logic_error, std::out_of_range
+  MappedBitArray &set_range(size_t pos, size_t len, bool val = true);
+  MappedBitArray &reset_range(size_t pos, size_t len);
+  MappedBitArray &flip_range(size_t pos, size_t len);
+
+  // Count bits of value 1 in range [pos, pos + len)
+  size_t count_range(size_t pos, size_t len) const;
+
+  // Bit operators, arrays must have the same size
+  MappedBitArray &operator&=(const BitArray &b);
+  MappedBitArray &operator|=(const BitArray &b);
+  MappedBitArray &operator^=(const BitArray &b);
+
+  // True, if at least one bit of value 1
+  bool any() const;
+
+  // True, if all bits are 0's
+  bool none() const;
+
+  // Count bits of value 1
+  size_t count() const;
+
+  // Return i'th bit value
+  bool get(size_t i) const;
+  bool operator[](size_t i) const;
+
+  size_t size() const { return bits; }
+  bool empty() const { return bits == 0; }
+
+  // Return i'th byte, 0 if it is out of range
+  byte_type byte(size_t i) const { return i < byte_count() ? bytes[i] : 0; }
+
+  const byte_type *data() const { return bytes; }
+
+  // View of bits [pos, pos + len), len is cut at the end of the array
+  // Writable view of read-only array throws std::logic_error
+  ConstBitSpan span(size_t pos = 0, size_t len = npos) const;
+  BitSpan span(size_t pos = 0, size_t len = npos);
+
+  // Position of the first bit of value 1 (0), or npos
+  size_t find_first() const;
+  size_t find_first_zero() const;
+
+  // Position of the last bit of value 1 (0), or npos
+  size_t find_last() const;
+  size_t find_last_zero() const;
+
+  // Position of the first bit of value 1 (0) after i'th bit, or npos
+  size_t find_next(size_t i) const;
+  size_t find_next_zero(size_t i) const;
+
+  // Call f(i) for every bit of value 1 in ascending order
+  template <class F> void for_each_set_bit(F f) const {
+    const size_t size = byte_count();
+
+    for (size_t byte_pos = 0; byte_pos < size; byte_pos++) {
+      for (byte_type byte = bytes[byte_pos]; byte; byte &= byte - 1) {
+        f(byte_pos * BitArray::byte_bits + __builtin_ctzl(byte));
+      }
+    }
+  }
+
+  // Return string representation of bit array
+  std::string to_string() const;
+};
+
+// Mapped arrays are used in expressions by reference, like bit arrays
+template <> struct BitExprTraits<MappedBitArray> {
+  using store = const MappedBitArray &;
+  static constexpr bool elementwise = true;
+};
+
+bool operator==(const MappedBitArray &b1, const BitArray &b2);
+bool operator!=(const MappedBitArray &b1, const BitArray &b2);
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef PACKED_INT_ARRAY
+#define PACKED_INT_ARRAY
+
+#include "bit-kernels.h"
+#include "bit-span.h"
+#include "byte-storage.h"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Array of unsigned integers of K bits each (1 to 64), packed one after
+// another into bytes like in BitArray, so a value may cross two bytes.
+// K = 0 gives the width at runtime: PackedIntArray<>(size, width).
+// One byte after the values is always kept and is 0, so every value is read
+// by two loads and shifts without branches, and bulk unpack of BitKernels
+// may read past the last value.
+template <int K = 0> class PackedIntArray {
+  static_assert(K >= 0 && K <= 64, "Width must be in [0, 64]");
+
+public:
+  static constexpr int byte_bits = ConstBitSpan::byte_bits;
+
+  // Widths of values, which unpack() and pack() take
+  static constexpr int max_bulk_width = 32;
+
+private:
+  ByteStorage bytes;
+  size_t len;
+  int w;
+
+  static size_t to_bytes(size_t bits) {
+    return (bits + byte_bits - 1) / byte_bits;
+  }
+
+  size_t bits() const { return len * width(); }
+
+  // Bytes of 'size' values and the padding byte
+  size_t storage_size(size_t size) const {
+    if (size > (size_t(-1) - byte_bits) / width()) {
+      throw std::invalid_argument("Packed array is too long");
+    }
+    return to_bytes(size * width()) + 1;
+  }
+
+  void check(size_t i, const char *msg) const {
+    if (i >= len) {
+      throw std::out_of_range(msg);
+    }
+  }
+
+  void check_range(size_t pos, size_t count, const char *msg) const {
+    if (pos > len || count > len - pos) {
+      throw std::out_of_range(msg);
+    }
+  }
+
+  void check_bulk() const {
+    if (width() > max_bulk_width) {
+      throw std::invalid_argument("Bulk operations need width of at most 32");
+    }
+  }
+
+  void check_value(uint64_t value) const {
+    if (value & ~mask()) {
+      throw std::invalid_argument("Value does not fit into packed array");
+    }
+  }
+
+public:
+  // Array of 'size' zeros of 'width' bits
+  // Throws std::invalid_argument, if width is out of [1, 64] or differs
+  // from K
+  explicit PackedIntArray(size_t size = 0, int width = K) : len(0), w(width) {
+    if (width < 1 || width > 64 || (K != 0 && width != K)) {
+      throw std::invalid_argument("Width of packed array must be in [1, 64]");
+    }
+
+    bytes.resize(storage_size(size));
+    len = size;
+  }
+
+  int width() const { return K != 0 ? K : w; }
+
+  // Largest value, which fits
+  uint64_t mask() const {
+    return width() == 64 ? ~0UL : (1UL << width()) - 1;
+  }
+
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+
+  // Return i'th value without range check
+  uint64_t operator[](size_t i) const {
+    const size_t pos = i * width();
+    const size_t q = pos / byte_bits;
+    const int offset = pos % byte_bits;
+
+    // Second shift is split, so offset 0 takes nothing from the next byte
+    const byte_type low = bytes[q] >> offset;
+    const byte_type high = (bytes[q + 1] << 1) << (byte_bits - 1 - offset);
+
+    return (low | high) & mask();
+  }
+
+  // Return i'th value, throws std::out_of_range
+  uint64_t get(size_t i) const {
+    check(i, "Unable to get: i is out of range");
+    return (*this)[i];
+  }
+
+  // Set i'th value
+  // Throws std::out_of_range, std::invalid_argument if value doesn't fit
+  PackedIntArray &set(size_t i, uint64_t value) {
+    check(i, "Unable to set: i is out of range");
+    check_value(value);
+
+    const size_t pos = i * width();
+    const size_t q = pos / byte_bits;
+    const int offset = pos % byte_bits;
+
+    // Part of the value in the next byte is empty, if it fits in this one
+    const int rest = byte_bits - 1 - offset;
+    bytes[q] = (bytes[q] & ~(mask() << offset)) | (value << offset);
+    bytes[q + 1] = (bytes[q + 1] & ~((mask() >> 1) >> rest)) |
+                   ((value >> 1) >> rest);
+
+    return *this;
+  }
+
+  // Add value to the end
+  // Throws std::invalid_argument if value doesn't fit
+  PackedIntArray &push_back(uint64_t value) {
+    check_value(value);
+    resize(len + 1);
+    return set(len - 1, value);
+  }
+
+  // Change size, new values are 0
+  PackedIntArray &resize(size_t size) {
+    const size_t new_bytes = storage_size(size);
+
+    // Bits after the last value stay 0
+    if (size < len) {
+      BitSpan(bytes.data(), size * width(), (len - size) * width()).reset();
+    }
+
+    bytes.resize(new_bytes);
+    len = size;
+
+    return *this;
+  }
+
+  // Remove all values
+  PackedIntArray &clear() { return resize(0); }
+
+  // out[j] = value of pos + j for j in [0, count)
+  // Throws std::out_of_range, std::invalid_argument if width is above 32
+  void unpack(size_t pos, size_t count, uint32_t *out) const {
+    check_range(pos, count, "Unable to unpack: range is out of array");
+    check_bulk();
+
+    BitKernels::unpack(bytes.data(), pos * width(), width(), out, count);
+  }
+
+  // Set values [pos, pos + count) to in[j]
+  // Throws std::out_of_range, std::invalid_argument if width is above 32 or
+  // some value doesn't fit (then nothing is written)
+  PackedIntArray &pack(size_t pos, const uint32_t *in, size_t count) {
+    check_range(pos, count, "Unable to pack: range is out of array");
+    check_bulk();
+
+    uint32_t all = 0;
+    for (size_t j = 0; j < count; j++) {
+      all |= in[j];
+    }
+    check_value(all);
+
+    BitKernels::pack(bytes.data(), pos * width(), width(), in, count);
+    return *this;
+  }
+
+  // Bits of all values, the first value is bits [0, width)
+  ConstBitSpan span() const { return ConstBitSpan(bytes.data(), 0, bits()); }
+
+  // Bytes of memory, including the padding byte
+  size_t memory_bytes() const { return bytes.size() * sizeof(byte_type); }
+};
+
+#endif
@@ -0,0 +1,509 @@
+#include "roaring-bit-array.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+// Container
+
+bool RoaringBitArray::Container::get(uint16_t low) const {
+  switch (type) {
+  case Type::array:
+    return std::binary_search(values.begin(), values.end(), low);
+  case Type::bitmap:
+    return (bytes[low / BitArray::byte_bits] >> (low % BitArray::byte_bits)) &
+           1UL;
+  case Type::run:
+    // Last run, which starts before or at 'low'
+    for (int lo = 0, hi = values.size() / 2; hi - lo > 0;) {
+      const int mid = (lo + hi) / 2;
+      const int start = values[2 * mid];
+
+      if (low < start) {
+        hi = mid;
+      } else if (low > start + values[2 * mid + 1]) {
+        lo = mid + 1;
+      } else {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  return false;
+}
+
+void RoaringBitArray::Container::set(uint16_t low) {
+  unrun();
+
+  if (type == Type::array) {
+    const auto it = std::lower_bound(values.begin(), values.end(), low);
+
+    if (it != values.end() && *it == low) {
+      return;
+    }
+
+    values.insert(it, low);
+    cardinality++;
+    normalize();
+    return;
+  }
+
+  byte_type &byte = bytes[low / BitArray::byte_bits];
+  const byte_type mask = 1UL << (low % BitArray::byte_bits);
+
+  if (!(byte & mask)) {
+    byte |= mask;
+    cardinality++;
+  }
+}
+
+void RoaringBitArray::Container::reset(uint16_t low) {
+  unrun();
+
+  if (type == Type::array) {
+    const auto it = std::lower_bound(values.begin(), values.end(), low);
+
+    if (it != values.end() && *it == low) {
+      values.erase(it);
+      cardinality--;
+    }
+    return;
+  }
+
+  byte_type &byte = bytes[low / BitArray::byte_bits];
+  const byte_type mask = 1UL << (low % BitArray::byte_bits);
+
+  if (byte & mask) {
+    byte &= ~mask;
+    cardinality--;
+    normalize();
+  }
+}
+
+std::vector<byte_type> RoaringBitArray::Container::to_bytes() const {
+  if (type == Type::bitmap) {
+    return bytes;
+  }
+
+  std::vector<byte_type> res(chunk_bytes);
+
+  for_each([&](int low) {
+    res[low / BitArray::byte_bits] |= 1UL << (low % BitArray::byte_bits);
+  });
+
+  return res;
+}
+
+RoaringBitArray::Container
+RoaringBitArray::Container::from_bytes(std::vector<byte_type> bytes,
+                                       int cardinality) {
+  Container c;
+  c.type = Type::bitmap;
+  c.bytes = std::move(bytes);
+  c.cardinality = cardinality;
+  c.normalize();
+  return c;
+}
+
+void RoaringBitArray::Container::unrun() {
+  if (type != Type::run) {
+    return;
+  }
+
+  if (cardinality > array_max) {
+    bytes = to_bytes();
+    type = Type::bitmap;
+  } else {
+    std::vector<uint16_t> array;
+    array.reserve(cardinality);
+    for_each([&](int low) { array.push_back(low); });
+    values.swap(array);
+    type = Type::array;
+  }
+
+  if (type == Type::bitmap) {
+    values.clear();
+    values.shrink_to_fit();
+  }
+}
+
+void RoaringBitArray::Container::normalize() {
+  if (type == Type::array && cardinality > array_max) {
+    bytes = to_bytes();
+    values.clear();
+    values.shrink_to_fit();
+    type = Type::bitmap;
+  } else if (type == Type::bitmap && cardinality <= array_max) {
+    values.clear();
+    values.reserve(cardinality);
+    for_each([&](int low) { values.push_back(low); });
+    bytes.clear();
+    bytes.shrink_to_fit();
+    type = Type::array;
+  }
+}
+
+int RoaringBitArray::Container::runs() const {
+  if (type == Type::run) {
+    return values.size() / 2;
+  }
+
+  int runs = 0;
+  int prev = -2;
+
+  for_each([&](int low) {
+    runs += low != prev + 1;
+    prev = low;
+  });
+
+  return runs;
+}
+
+void RoaringBitArray::Container::optimize() {
+  const int run_count = runs();
+  const size_t run_size = run_count * 2 * sizeof(uint16_t);
+  const size_t other_size = cardinality > array_max
+                                ? chunk_bytes * sizeof(byte_type)
+                                : cardinality * sizeof(uint16_t);
+
+  if (type == Type::run) {
+    if (other_size < run_size) {
+      unrun();
+    }
+    return;
+  }
+
+  if (run_size >= other_size) {
+    return;
+  }
+
+  std::vector<uint16_t> res;
+  res.reserve(run_count * 2);
+  int prev = -2;
+
+  for_each([&](int low) {
+    if (low != prev + 1) {
+      res.push_back(low);
+      res.push_back(0);
+    } else {
+      res.back()++;
+    }
+    prev = low;
+  });
+
+  values.swap(res);
+  bytes.clear();
+  bytes.shrink_to_fit();
+  type = Type::run;
+}
+
+size_t RoaringBitArray::Container::size_in_bytes() const {
+  return values.capacity() * sizeof(uint16_t) +
+         bytes.capacity() * sizeof(byte_type);
+}
+
+// Private
+
+const RoaringBitArray::Container *RoaringBitArray::find(size_t key) const {
+  const auto it = std::lower_bound(keys.begin(), keys.end(), key);
+
+  if (it == keys.end() || *it != key) {
+    return nullptr;
+  }
+
+  return &containers[it - keys.begin()];
+}
+
+void RoaringBitArray::check(size_t n, const char *msg) const {
+  if (n >= bits) {
+    throw std::out_of_range(msg);
+  }
+}
+
+// Merge containers of both arrays chunk by chunk
+// Chunks present only in one array are kept if 'keep_single' is set
+template <class ArrayOp, class BytesOp>
+RoaringBitArray RoaringBitArray::merge(const RoaringBitArray &b1,
+                                       const RoaringBitArray &b2,
+                                       bool keep_single, ArrayOp array_op,
+                                       BytesOp bytes_op) {
+  if (b1.bits != b2.bits) {
+    throw std::invalid_argument(
+        "RoaringBitArrays must have the same size for bitwise operator");
+  }
+
+  RoaringBitArray res(b1.bits);
+  size_t i = 0, j = 0;
+
+  const auto push = [&](size_t key, Container c) {
+    if (c.cardinality > 0) {
+      res.keys.push_back(key);
+      res.containers.push_back(std::move(c));
+    }
+  };
+
+  while (i < b1.keys.size() || j < b2.keys.size()) {
+    if (j == b2.keys.size() ||
+        (i < b1.keys.size() && b1.keys[i] < b2.keys[j])) {
+      if (keep_single) {
+        push(b1.keys[i], b1.containers[i]);
+      }
+      i++;
+      continue;
+    }
+
+    if (i == b1.keys.size() || b2.keys[j] < b1.keys[i]) {
+      if (keep_single) {
+        push(b2.keys[j], b2.containers[j]);
+      }
+      j++;
+      continue;
+    }
+
+    const Container &c1 = b1.containers[i];
+    const Container &c2 = b2.containers[j];
+
+    if (c1.type == Type::array && c2.type == Type::array) {
+      Container c;
+      array_op(c1.values.begin(), c1.values.end(), c2.values.begin(),
+               c2.values.end(), std::back_inserter(c.values));
+      c.cardinality = c.values.size();
+      c.normalize();
+      push(b1.keys[i], std::move(c));
+    } else {
+      std::vector<byte_type> bytes = c1.to_bytes();
+      const std::vector<byte_type> other = c2.to_bytes();
+      bytes_op(bytes.data(), other.data(), chunk_bytes);
+      const int cardinality = BitKernels::count(bytes.data(), chunk_bytes);
+      push(b1.keys[i], Container::from_bytes(std::move(bytes), cardinality));
+    }
+
+    i++;
+    j++;
+  }
+
+  return res;
+}
+
+// Public
+
+RoaringBitArray::RoaringBitArray() : bits(0) {}
+
+RoaringBitArray::RoaringBitArray(size_t num_bits) : bits(num_bits) {}
+
+RoaringBitArray::RoaringBitArray(const BitArray &b) : bits(b.size()) {
+  const size_t size = b.byte_count();
+
+  for (size_t begin = 0; begin < size; begin += chunk_bytes) {
+    const byte_type *bytes = b.data() + begin;
+    const size_t count = std::min(chunk_bytes, size - begin);
+
+    if (!BitKernels::any(bytes, count)) {
+      continue;
+    }
+
+    Container c;
+    c.cardinality = BitKernels::count(bytes, count);
+
+    if (c.cardinality > array_max) {
+      c.type = Type::bitmap;
+      c.bytes.assign(bytes, bytes + count);
+      c.bytes.resize(chunk_bytes);
+    } else {
+      c.values.reserve(c.cardinality);
+
+      for (size_t i = 0; i < count; i++) {
+        for (byte_type byte = bytes[i]; byte; byte &= byte - 1) {
+          c.values.push_back(i * BitArray::byte_bits + __builtin_ctzl(byte));
+        }
+      }
+    }
+
+    keys.push_back(begin / chunk_bytes);
+    containers.push_back(std::move(c));
+  }
+
+  optimize();
+}
+
+BitArray RoaringBitArray::to_bit_array() const {
+  BitArray b(bits);
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    const size_t base = keys[i] * chunk_bits;
+    const Container &c = containers[i];
+
+    if (c.type == Type::bitmap) {
+      const BitSpan chunk = b.span(base, chunk_bits);
+      chunk.assign(ConstBitSpan(c.bytes.data(), 0, chunk.size()));
+    } else {
+      c.for_each_run([&](int start, int length) {
+        b.set_range(base + start, length);
+      });
+    }
+  }
+
+  return b;
+}
+
+RoaringBitArray &RoaringBitArray::set(size_t n, bool val) {
+  check(n, "Unable to set: n is out of range");
+
+  if (!val) {
+    return reset(n);
+  }
+
+  const size_t key = n / chunk_bits;
+  const auto it = std::lower_bound(keys.begin(), keys.end(), key);
+  const size_t pos = it - keys.begin();
+
+  if (it == keys.end() || *it != key) {
+    keys.insert(it, key);
+    containers.insert(containers.begin() + pos, Container());
+  }
+
+  containers[pos].set(n % chunk_bits);
+
+  return *this;
+}
+
+RoaringBitArray &RoaringBitArray::reset(size_t n) {
+  check(n, "Unable to reset: n is out of range");
+
+  const size_t key = n / chunk_bits;
+  const auto it = std::lower_bound(keys.begin(), keys.end(), key);
+
+  if (it == keys.end() || *it != key) {
+    return *this;
+  }
+
+  const size_t pos = it - keys.begin();
+  Container &c = containers[pos];
+  c.reset(n % chunk_bits);
+
+  if (c.cardinality == 0) {
+    keys.erase(it);
+    containers.erase(containers.begin() + pos);
+  }
+
+  return *this;
+}
+
+RoaringBitArray &RoaringBitArray::reset() {
+  keys.clear();
+  containers.clear();
+  return *this;
+}
+
+bool RoaringBitArray::get(size_t i) const {
+  check(i, "Unable to get: i is out of range");
+
+  const Container *c = find(i / chunk_bits);
+  return c && c->get(i % chunk_bits);
+}
+
+bool RoaringBitArray::operator[](size_t i) const { return get(i); }
+
+size_t RoaringBitArray::count() const {
+  size_t count = 0;
+
+  for (const Container &c : containers) {
+    count += c.cardinality;
+  }
+
+  return count;
+}
+
+bool RoaringBitArray::any() const { return !containers.empty(); }
+
+bool RoaringBitArray::none() const { return !any(); }
+
+size_t RoaringBitArray::size() const { return bits; }
+
+bool RoaringBitArray::empty() const { return bits == 0; }
+
+RoaringBitArray &RoaringBitArray::optimize() {
+  for (Container &c : containers) {
+    c.optimize();
+  }
+
+  return *this;
+}
+
+size_t RoaringBitArray::size_in_bytes() const {
+  size_t size = keys.capacity() * sizeof(size_t) +
+                containers.capacity() * sizeof(Container);
+
+  for (const Container &c : containers) {
+    size += c.size_in_bytes();
+  }
+
+  return size;
+}
+
+RoaringBitArray &RoaringBitArray::operator&=(const RoaringBitArray &b) {
+  return *this = *this & b;
+}
+
+RoaringBitArray &RoaringBitArray::operator|=(const RoaringBitArray &b) {
+  return *this = *this | b;
+}
+
+RoaringBitArray &RoaringBitArray::operator^=(const RoaringBitArray &b) {
+  return *this = *this ^ b;
+}
+
+// Functions
+
+RoaringBitArray operator&(const RoaringBitArray &b1,
+                          const RoaringBitArray &b2) {
+  return RoaringBitArray::merge(
+      b1, b2, false,
+      [](auto... args) { std::set_intersection(args...); },
+      BitKernels::bit_and);
+}
+
+RoaringBitArray operator|(const RoaringBitArray &b1,
+                          const RoaringBitArray &b2) {
+  return RoaringBitArray::merge(
+      b1, b2, true, [](auto... args) { std::set_union(args...); },
+      BitKernels::bit_or);
+}
+
+RoaringBitArray operator^(const RoaringBitArray &b1,
+                          const RoaringBitArray &b2) {
+  return RoaringBitArray::merge(
+      b1, b2, true,
+      [](auto... args) { std::set_symmetric_difference(args...); },
+      BitKernels::bit_xor);
+}
+
+bool operator==(const RoaringBitArray &b1, const RoaringBitArray &b2) {
+  if (b1.bits != b2.bits || b1.keys != b2.keys) {
+    return false;
+  }
+
+  for (size_t i = 0; i < b1.containers.size(); i++) {
+    const RoaringBitArray::Container &c1 = b1.containers[i];
+    const RoaringBitArray::Container &c2 = b2.containers[i];
+
+    if (c1.cardinality != c2.cardinality) {
+      return false;
+    }
+
+    // Containers of the same type keep the same bits in the same way
+    const bool equal =
+        c1.type != c2.type ? c1.to_bytes() == c2.to_bytes()
+        : c1.type == RoaringBitArray::Type::bitmap ? c1.bytes == c2.bytes
+                                                   : c1.values == c2.values;
+    if (!equal) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool operator!=(const RoaringBitArray &b1, const RoaringBitArray &b2) {
+  return !(b1 == b2);
+}
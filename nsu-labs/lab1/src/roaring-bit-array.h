@@ -0,0 +1,199 @@
+#ifndef ROARING_BIT_ARRAY
+#define ROARING_BIT_ARRAY
+
+#include "bit-array.h"
+#include <cstdint>
+#include <vector>
+
+// Compressed bit array in the style of Roaring bitmaps
+// Positions are split into chunks of 2^16 bits, only non-empty chunks are
+// stored, each in the smallest of three containers:
+// - array of positions for sparse chunks,
+// - plain bitmap for dense chunks,
+// - runs of consecutive ones (after optimize()).
+class RoaringBitArray {
+public:
+  static constexpr size_t chunk_bits = 1 << 16;
+
+  // Chunks with more ones are stored as bitmaps
+  static constexpr int array_max = 4096;
+
+private:
+  static constexpr size_t chunk_bytes = chunk_bits / BitArray::byte_bits;
+
+  enum class Type { array, bitmap, run };
+
+  struct Container {
+    Type type = Type::array;
+
+    // Array: sorted positions
+    // Run: pairs of run start and run length - 1
+    std::vector<uint16_t> values;
+
+    // Bitmap: chunk_bytes bytes
+    std::vector<byte_type> bytes;
+
+    int cardinality = 0;
+
+    bool get(uint16_t low) const;
+    void set(uint16_t low);
+    void reset(uint16_t low);
+
+    // Bytes of the chunk, whatever container is used
+    std::vector<byte_type> to_bytes() const;
+    static Container from_bytes(std::vector<byte_type> bytes, int cardinality);
+
+    // Convert run container, so it can be changed
+    void unrun();
+
+    // Pick array or bitmap by cardinality
+    void normalize();
+
+    // Pick the smallest container, including runs
+    void optimize();
+
+    // Number of runs of ones
+    int runs() const;
+
+    size_t size_in_bytes() const;
+
+    template <class F> void for_each(F f) const;
+
+    // Call f(start, length) for every run of ones
+    template <class F> void for_each_run(F f) const;
+  };
+
+  std::vector<size_t> keys;
+  std::vector<Container> containers;
+  size_t bits;
+
+  // Container of the chunk, nullptr if chunk is empty
+  const Container *find(size_t key) const;
+
+  void check(size_t n, const char *msg) const;
+
+  template <class ArrayOp, class BytesOp>
+  static RoaringBitArray merge(const RoaringBitArray &b1,
+                               const RoaringBitArray &b2, bool keep_single,
+                               ArrayOp array_op, BytesOp bytes_op);
+
+public:
+  RoaringBitArray();
+
+  // Construct empty array, with specified amount of bits
+  explicit RoaringBitArray(size_t num_bits);
+
+  // Compress bit array
+  explicit RoaringBitArray(const BitArray &b);
+
+  // Decompress to bit array
+  BitArray to_bit_array() const;
+
+  // Set n'th bit to 'value'
+  RoaringBitArray &set(size_t n, bool val = true);
+
+  // Set n'th bit to 0
+  RoaringBitArray &reset(size_t n);
+
+  // Remove all 1's
+  RoaringBitArray &reset();
+
+  // Return i'th bit value
+  bool get(size_t i) const;
+  bool operator[](size_t i) const;
+
+  // Count bits of value 1
+  size_t count() const;
+
+  // True, if at least one bit of value 1
+  bool any() const;
+
+  // True, if all bits are 0's
+  bool none() const;
+
+  size_t size() const;
+  bool empty() const;
+
+  // Convert chunks to run containers, where it saves memory
+  RoaringBitArray &optimize();
+
+  // Memory used by containers
+  size_t size_in_bytes() const;
+
+  // Call f(i) for every bit of value 1 in ascending order
+  template <class F> void for_each_set_bit(F f) const;
+
+  // Bit operators for bit arrays of the same size
+  RoaringBitArray &operator&=(const RoaringBitArray &b);
+  RoaringBitArray &operator|=(const RoaringBitArray &b);
+  RoaringBitArray &operator^=(const RoaringBitArray &b);
+
+  friend RoaringBitArray operator&(const RoaringBitArray &b1,
+                                   const RoaringBitArray &b2);
+  friend RoaringBitArray operator|(const RoaringBitArray &b1,
+                                   const RoaringBitArray &b2);
+  friend RoaringBitArray operator^(const RoaringBitArray &b1,
+                                   const RoaringBitArray &b2);
+  friend bool operator==(const RoaringBitArray &b1, const RoaringBitArray &b2);
+};
+
+bool operator!=(const RoaringBitArray &b1, const RoaringBitArray &b2);
+
+template <class F> void RoaringBitArray::Container::for_each(F f) const {
+  switch (type) {
+  case Type::array:
+    for (const uint16_t low : values) {
+      f(low);
+    }
+    break;
+  case Type::bitmap:
+    for (size_t i = 0; i < chunk_bytes; i++) {
+      for (byte_type byte = bytes[i]; byte; byte &= byte - 1) {
+        f(i * BitArray::byte_bits + __builtin_ctzl(byte));
+      }
+    }
+    break;
+  case Type::run:
+    for (size_t i = 0; i < values.size(); i += 2) {
+      for (int low = values[i]; low <= values[i] + values[i + 1]; low++) {
+        f(low);
+      }
+    }
+    break;
+  }
+}
+
+template <class F> void RoaringBitArray::Container::for_each_run(F f) const {
+  if (type == Type::run) {
+    for (size_t i = 0; i < values.size(); i += 2) {
+      f(values[i], values[i + 1] + 1);
+    }
+    return;
+  }
+
+  int start = -1;
+  int end = -1;
+
+  for_each([&](int low) {
+    if (low != end) {
+      if (start >= 0) {
+        f(start, end - start);
+      }
+      start = low;
+    }
+    end = low + 1;
+  });
+
+  if (start >= 0) {
+    f(start, end - start);
+  }
+}
+
+template <class F> void RoaringBitArray::for_each_set_bit(F f) const {
+  for (size_t i = 0; i < keys.size(); i++) {
+    const size_t base = keys[i] * chunk_bits;
+    containers[i].for_each([&](int low) { f(base + low); });
+  }
+}
+
+#endif
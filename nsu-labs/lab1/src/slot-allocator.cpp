@@ -0,0 +1,231 @@
+#include "slot-allocator.h"
+#include <stdexcept>
+
+namespace {
+
+constexpr int byte_bits = BitArray::byte_bits;
+
+constexpr byte_type full_byte = ~0UL;
+
+// Sizes of levels, each level has a bit per byte of the level below
+std::vector<size_t> level_sizes(size_t slots) {
+  std::vector<size_t> sizes{slots};
+
+  while (sizes.back() > byte_bits) {
+    sizes.push_back((sizes.back() + byte_bits - 1) / byte_bits);
+  }
+
+  return sizes;
+}
+
+// Bits of i'th byte after the end of level of 'bits' bits
+byte_type padding(size_t bits, size_t i) {
+  if (i >= (bits + byte_bits - 1) / byte_bits) {
+    return full_byte;
+  }
+
+  const int used = i + 1 == (bits + byte_bits - 1) / byte_bits
+                       ? bits % byte_bits
+                       : 0;
+  return used ? full_byte << used : 0;
+}
+
+byte_type bit_mask(size_t i) { return 1UL << (i % byte_bits); }
+
+} // namespace
+
+// SlotAllocator
+
+byte_type SlotAllocator::byte(size_t level, size_t i) const {
+  return levels[level].byte(i) | padding(levels[level].size(), i);
+}
+
+SlotAllocator::SlotAllocator(size_t slots) {
+  for (size_t size : level_sizes(slots)) {
+    levels.emplace_back(size);
+  }
+}
+
+size_t SlotAllocator::find_first_zero() const {
+  size_t i = 0;
+
+  for (size_t level = levels.size(); level-- > 0;) {
+    const byte_type free = ~byte(level, i);
+
+    if (!free) {
+      return npos;
+    }
+
+    i = i * byte_bits + __builtin_ctzl(free);
+  }
+
+  return i;
+}
+
+size_t SlotAllocator::claim() {
+  const size_t slot = find_first_zero();
+
+  if (slot == npos) {
+    return npos;
+  }
+
+  // Full bytes are marked up to the first level, which stays not full
+  for (size_t level = 0, i = slot; level < levels.size(); level++) {
+    levels[level].set(i);
+    i /= byte_bits;
+
+    if (byte(level, i) != full_byte) {
+      break;
+    }
+  }
+
+  return slot;
+}
+
+void SlotAllocator::release(size_t i) {
+  if (!test(i)) {
+    throw std::invalid_argument("Unable to release: slot is free");
+  }
+
+  // Bytes, which were full, are marked free up to the first one, which
+  // was not
+  for (size_t level = 0; level < levels.size(); level++) {
+    const bool was_full = byte(level, i / byte_bits) == full_byte;
+
+    levels[level].reset(i);
+    i /= byte_bits;
+
+    if (!was_full) {
+      break;
+    }
+  }
+}
+
+// AtomicSlotAllocator
+
+byte_type AtomicSlotAllocator::byte(size_t level, size_t i,
+                                    std::memory_order order) const {
+  return levels[level].byte(i, order) | padding(levels[level].size(), i);
+}
+
+void AtomicSlotAllocator::mark_full(size_t level, size_t i) {
+  for (; level + 1 < levels.size(); level++, i /= byte_bits) {
+    AtomicBitArray &upper = levels[level + 1];
+    const size_t j = i / byte_bits;
+    const byte_type old = upper.fetch_or_word(j, bit_mask(i));
+
+    // Release may free a bit before the summary is set, then nobody
+    // clears it but this thread
+    if (byte(level, i) != full_byte) {
+      upper.fetch_and_word(j, ~bit_mask(i));
+      return;
+    }
+
+    if ((old | bit_mask(i) | padding(upper.size(), j)) != full_byte) {
+      return;
+    }
+  }
+}
+
+void AtomicSlotAllocator::mark_free(size_t level, size_t i) {
+  for (; level + 1 < levels.size(); level++, i /= byte_bits) {
+    AtomicBitArray &upper = levels[level + 1];
+    const size_t j = i / byte_bits;
+    const byte_type old = upper.fetch_and_word(j, ~bit_mask(i));
+
+    // Upper byte was not full, so levels above are right
+    if ((old | padding(upper.size(), j)) != full_byte) {
+      return;
+    }
+  }
+}
+
+AtomicSlotAllocator::AtomicSlotAllocator(size_t slots) {
+  for (size_t size : level_sizes(slots)) {
+    levels.emplace_back(size);
+  }
+}
+
+size_t AtomicSlotAllocator::find_first_zero() const {
+  size_t i = 0;
+
+  for (size_t level = levels.size(); level-- > 0;) {
+    const byte_type free = ~byte(level, i, std::memory_order_acquire);
+
+    if (!free) {
+      return npos;
+    }
+
+    i = i * byte_bits + __builtin_ctzl(free);
+  }
+
+  return i;
+}
+
+size_t AtomicSlotAllocator::claim() {
+  const size_t top = levels.size() - 1;
+
+  for (;;) {
+    size_t i = 0;
+    size_t level = top;
+
+    // Go down by summary bits, until a byte of slots or a full byte
+    byte_type free;
+
+    for (;;) {
+      free = ~byte(level, i, std::memory_order_acquire);
+
+      if (!free || level == 0) {
+        break;
+      }
+
+      i = i * byte_bits + __builtin_ctzl(free);
+      level--;
+    }
+
+    // Summary bit of 0 over a full byte is fixed, and search restarts
+    if (!free) {
+      if (level == top) {
+        return npos;
+      }
+      mark_full(level, i);
+      continue;
+    }
+
+    // Other threads may take free bits of the byte first
+    byte_type used = ~free;
+
+    while (used != full_byte) {
+      const int bit = __builtin_ctzl(~used);
+      const byte_type old = levels[0].fetch_or_word(i, 1UL << bit);
+
+      if (!(old & (1UL << bit))) {
+        if ((old | (1UL << bit) | padding(size(), i)) == full_byte) {
+          mark_full(0, i);
+        }
+        return i * byte_bits + bit;
+      }
+
+      used = old | padding(size(), i);
+    }
+
+    mark_full(0, i);
+  }
+}
+
+void AtomicSlotAllocator::release(size_t i) {
+  if (i >= size()) {
+    throw std::out_of_range("Unable to release: i is out of range");
+  }
+
+  const byte_type old =
+      levels[0].fetch_and_word(i / byte_bits, ~bit_mask(i));
+
+  if (!(old & bit_mask(i))) {
+    throw std::invalid_argument("Unable to release: slot is free");
+  }
+
+  if ((old | padding(size(), i / byte_bits)) == full_byte) {
+    mark_free(0, i / byte_bits);
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef SLOT_ALLOCATOR
+#define SLOT_ALLOCATOR
+
+#include "atomic-bit-array.h"
+#include "bit-array.h"
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Allocator of slots [0, size), bits of used slots are 1
+// Levels of summary above the slots keep a bit per byte of the level below,
+// which is 1, if that byte is full. Searches go down from the top byte and
+// skip full regions, so claim() and release() read O(log64 size) bytes.
+
+class SlotAllocator {
+private:
+  // levels[0] are slots, the last level fits one byte
+  std::vector<BitArray> levels;
+
+  // i'th byte of level, bits after the end of level read as used
+  byte_type byte(size_t level, size_t i) const;
+
+public:
+  static constexpr size_t npos = BitArray::npos;
+
+  explicit SlotAllocator(size_t slots);
+
+  size_t size() const { return levels[0].size(); }
+
+  // Number of used slots
+  size_t used() const { return levels[0].count(); }
+
+  bool full() const { return find_first_zero() == npos; }
+
+  // True, if i'th slot is used
+  bool test(size_t i) const { return levels[0].get(i); }
+
+  // First free slot, or npos
+  size_t find_first_zero() const;
+
+  // Mark the first free slot as used and return it, npos if all are used
+  size_t claim();
+
+  // Free used slot
+  // Throws std::out_of_range, std::invalid_argument if slot is free
+  void release(size_t i);
+
+  // Bits of slots
+  const BitArray &slots() const { return levels[0]; }
+};
+
+// Slot allocator, which many threads use without locks
+// Slots are claimed and released by atomic operations on bytes of slots.
+// Summary bits are hints: a thread, which finds a full byte under a bit of
+// 0, sets the bit, and a bit of 1 is checked against the byte after it is
+// set. Under concurrent releases claim() may skip just freed slots and
+// return npos for an allocator, which was full a moment ago.
+class AtomicSlotAllocator {
+private:
+  std::vector<AtomicBitArray> levels;
+
+  byte_type byte(size_t level, size_t i,
+                 std::memory_order order = std::memory_order_seq_cst) const;
+
+  // i'th byte of level became full (got a free bit), update levels above
+  void mark_full(size_t level, size_t i);
+  void mark_free(size_t level, size_t i);
+
+public:
+  static constexpr size_t npos = BitArray::npos;
+
+  explicit AtomicSlotAllocator(size_t slots);
+
+  size_t size() const { return levels[0].size(); }
+
+  // Number of used slots, exact only if no other thread works
+  size_t used() const { return levels[0].count(); }
+
+  // True, if i'th slot is used
+  bool test(size_t i) const { return levels[0].get(i); }
+
+  // Free slot at the moment of the search, or npos
+  size_t find_first_zero() const;
+
+  // Mark a free slot as used and return it, npos if all are used
+  size_t claim();
+
+  // Free used slot
+  // Throws std::out_of_range, std::invalid_argument if slot is free
+  void release(size_t i);
+
+  // Copy of slot bits, not a snapshot, if other threads work
+  BitArray slots() const { return levels[0].to_bit_array(); }
+};
+
+#endif